@@ -0,0 +1,285 @@
+/*
+ * linux/fs/ods5/cache.c
+ *
+ * This file is part of the OpenVMS ODS5 file system for Linux.
+ * Copyright (C) 2017 Hartmut Becker.
+ *
+ * The OpenVMS ODS5 file system for Linux is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The OpenVMS ODS5 file system for Linux is distributed in the hope that it
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/fs.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/shrinker.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/sysfs.h>
+
+#include "./ods5_fs.h"
+#include "./ods5.h"
+
+/*
+ * Memory budget of the driver caches.
+ * The entries of the reverse name cache, the decoded file headers and, per
+ * inode, the maps of the extension headers and the record index are
+ * charged to the volume and kept on one LRU list, the most recently used
+ * first. When the charged bytes exceed the budget, the cache_kb mount
+ * option or /sys/fs/ods5/<device>/cache_budget_kb, entries are dropped from
+ * the tail; under memory pressure the shrinker does the same. The maps and
+ * the index of an inode are only dropped while the inode is unused, with
+ * i_count zero under i_lock: then nobody walks them and a later mapvbn
+ * reads the extension headers again. Entries of inodes in use go back to
+ * the head, so a trim after a charge looks at a few entries only: when the
+ * entries in use alone exceed the budget, the next trim goes on with the
+ * entries behind them instead of rotating the whole list again. A change
+ * of the budget trims the whole list once. One lock, cache_lock, protects
+ * the list, the counters, the name cache and the header cache. The primary
+ * map is part of the inode, it goes with the inode cache.
+ */
+
+/* entries dropped per lock hold, the record indexes are freed outside */
+#define ODS5_CACHE_BATCH	16
+/* entries looked at per charge */
+#define ODS5_CACHE_TRIM		(4 * ODS5_CACHE_BATCH)
+
+static const char *cache_types[] = {
+	[ODS5_CACHE_NAME] = "names",
+	[ODS5_CACHE_INODE] = "inodes",
+	[ODS5_CACHE_HEADER] = "headers",
+};
+
+void ods5_cache_init(struct ods5_sb_info *sb_info)
+{
+	spin_lock_init(&sb_info->cache_lock);
+	INIT_LIST_HEAD(&sb_info->cache_lru);
+	sb_info->cache_count = 0;
+	sb_info->cache_total = 0;
+	memset(sb_info->cache_bytes, 0, sizeof sb_info->cache_bytes);
+}
+
+/* with cache_lock: charge bytes more to ce and make it the most recent */
+void __ods5_cache_add(struct ods5_sb_info *sb_info, struct ods5_cache_ent *ce,
+		      vms_long bytes)
+{
+	if (list_empty(&ce->lru))
+		sb_info->cache_count++;
+	list_move(&ce->lru, &sb_info->cache_lru);
+	ce->bytes += bytes;
+	sb_info->cache_bytes[ce->type] += bytes;
+	sb_info->cache_total += bytes;
+}
+
+/* with cache_lock: take ce off the list, with all its bytes */
+void __ods5_cache_del(struct ods5_sb_info *sb_info, struct ods5_cache_ent *ce)
+{
+	if (list_empty(&ce->lru))
+		return;
+	list_del_init(&ce->lru);
+	sb_info->cache_count--;
+	sb_info->cache_bytes[ce->type] -= ce->bytes;
+	sb_info->cache_total -= ce->bytes;
+	ce->bytes = 0;
+}
+
+static int over_budget(struct ods5_sb_info *sb_info)
+{
+	unsigned long kb;
+
+	kb = READ_ONCE(sb_info->cache_kb);
+	return kb && sb_info->cache_total > kb << 10;
+}
+
+/*
+ * With cache_lock: drop the maps and the index of an unused inode, the
+ * index is returned, to be freed without the lock. If the inode is in use
+ * it is moved to the head and ERR_PTR(-EBUSY) is returned.
+ */
+static struct ods5_rms *inode_drop(struct ods5_sb_info *sb_info,
+				   struct ods5_cache_ent *ce)
+{
+	struct ods5_fh_info *fh_info;
+	struct ods5_ext_info *ext, *next;
+	struct ods5_rms *rms;
+	struct inode *inode;
+
+	fh_info = container_of(ce, struct ods5_fh_info, cache);
+	inode = fh_info->inode;
+	spin_lock(&inode->i_lock);
+	if (atomic_read(&inode->i_count)
+	    || (inode->i_state & (I_NEW | I_FREEING | I_WILL_FREE))) {
+		spin_unlock(&inode->i_lock);
+		list_move(&ce->lru, &sb_info->cache_lru);
+		return ERR_PTR(-EBUSY);
+	}
+	ext = fh_info->ext.next;
+	fh_info->ext.next = NULL;
+	rms = fh_info->rms;
+	fh_info->rms = NULL;
+	spin_unlock(&inode->i_lock);
+	__ods5_cache_del(sb_info, ce);
+	for (; ext; ext = next) {
+		next = ext->next;
+		kfree(ext);
+	}
+	return rms;
+}
+
+/*
+ * Drop up to nr entries from the tail, with budget only as long as the
+ * volume is over its budget. Returns the entries dropped.
+ */
+static unsigned long cache_scan(struct ods5_sb_info *sb_info,
+				unsigned long nr, int budget)
+{
+	struct ods5_rms *rms[ODS5_CACHE_BATCH], *r;
+	struct ods5_cache_ent *ce;
+	unsigned long freed;
+	int i, n;
+
+	freed = 0;
+	while (nr) {
+		n = 0;
+		spin_lock(&sb_info->cache_lock);
+		for (; nr && n < ODS5_CACHE_BATCH; nr--) {
+			if (list_empty(&sb_info->cache_lru)
+			    || (budget && !over_budget(sb_info))) {
+				nr = 0;
+				break;
+			}
+			ce = list_last_entry(&sb_info->cache_lru,
+					     struct ods5_cache_ent, lru);
+			switch (ce->type) {
+			    case ODS5_CACHE_NAME:
+				ods5_name_cache_drop(sb_info, ce);
+				freed++;
+				break;
+			    case ODS5_CACHE_HEADER:
+				ods5_hdr_drop(sb_info, ce);
+				freed++;
+				break;
+			    case ODS5_CACHE_INODE:
+				r = inode_drop(sb_info, ce);
+				if (IS_ERR(r))
+					break;
+				if (r)
+					rms[n++] = r;
+				freed++;
+				break;
+			}
+		}
+		spin_unlock(&sb_info->cache_lock);
+		for (i = 0; i < n; i++)
+			kvfree(rms[i]);
+		cond_resched();
+	}
+	return freed;
+}
+
+/* head for the budget, after something was charged */
+void ods5_cache_trim(struct ods5_sb_info *sb_info)
+{
+	if (!over_budget(sb_info))
+		return;
+	cache_scan(sb_info, ODS5_CACHE_TRIM, 1);
+}
+
+/* get back under a changed budget: every entry once, the in use ones rotate */
+void ods5_cache_trim_all(struct ods5_sb_info *sb_info)
+{
+	if (!over_budget(sb_info))
+		return;
+	cache_scan(sb_info, READ_ONCE(sb_info->cache_count), 1);
+}
+
+/* the maps or the index of the inode grew by bytes */
+void ods5_cache_charge(struct inode *inode, vms_long bytes)
+{
+	struct ods5_sb_info *sb_info;
+	struct ods5_fh_info *fh_info;
+
+	sb_info = get_sb_info(inode->i_sb);
+	fh_info = inode->i_private;
+	spin_lock(&sb_info->cache_lock);
+	__ods5_cache_add(sb_info, &fh_info->cache, bytes);
+	spin_unlock(&sb_info->cache_lock);
+	ods5_cache_trim(sb_info);
+}
+
+/* at eviction, before the maps and the index are freed */
+void ods5_cache_forget(struct inode *inode)
+{
+	struct ods5_sb_info *sb_info;
+	struct ods5_fh_info *fh_info;
+
+	sb_info = get_sb_info(inode->i_sb);
+	fh_info = inode->i_private;
+	spin_lock(&sb_info->cache_lock);
+	__ods5_cache_del(sb_info, &fh_info->cache);
+	spin_unlock(&sb_info->cache_lock);
+}
+
+static unsigned long cache_count_objects(struct shrinker *shrink,
+					 struct shrink_control *sc)
+{
+	struct ods5_sb_info *sb_info;
+
+	sb_info = container_of(shrink, struct ods5_sb_info, cache_shrinker);
+	return READ_ONCE(sb_info->cache_count);
+}
+
+static unsigned long cache_scan_objects(struct shrinker *shrink,
+					struct shrink_control *sc)
+{
+	struct ods5_sb_info *sb_info;
+
+	/* as the super block shrinker: not from within a file system */
+	if (!(sc->gfp_mask & __GFP_FS))
+		return SHRINK_STOP;
+	sb_info = container_of(shrink, struct ods5_sb_info, cache_shrinker);
+	return cache_scan(sb_info, sc->nr_to_scan, 0);
+}
+
+int ods5_cache_register(struct super_block *sb)
+{
+	struct ods5_sb_info *sb_info;
+
+	sb_info = get_sb_info(sb);
+	sb_info->cache_shrinker.count_objects = cache_count_objects;
+	sb_info->cache_shrinker.scan_objects = cache_scan_objects;
+	sb_info->cache_shrinker.seeks = DEFAULT_SEEKS;
+	return register_shrinker(&sb_info->cache_shrinker, "ods5-cache:%s",
+				 sb->s_id);
+}
+
+void ods5_cache_unregister(struct super_block *sb)
+{
+	unregister_shrinker(&get_sb_info(sb)->cache_shrinker);
+}
+
+/* for sysfs: the bytes per cache */
+ssize_t ods5_cache_usage(struct ods5_sb_info *sb_info, char *buf)
+{
+	unsigned long bytes[ODS5_CACHE_TYPES];
+	ssize_t len;
+	int i;
+
+	spin_lock(&sb_info->cache_lock);
+	memcpy(bytes, sb_info->cache_bytes, sizeof bytes);
+	spin_unlock(&sb_info->cache_lock);
+	len = 0;
+	for (i = 0; i < ODS5_CACHE_TYPES; i++)
+		len += sysfs_emit_at(buf, len, "%s:%lu%c", cache_types[i],
+				     bytes[i], i + 1 < ODS5_CACHE_TYPES ? ' ' : '\n');
+	return len;
+}
@@ -0,0 +1,201 @@
+/*
+ * linux/fs/ods5/debugfs.c
+ *
+ * This file is part of the OpenVMS ODS5 file system for Linux.
+ * Copyright (C) 2017 Hartmut Becker.
+ *
+ * The OpenVMS ODS5 file system for Linux is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The OpenVMS ODS5 file system for Linux is distributed in the hope that it
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+
+#include "./ods5_fs.h"
+#include "./ods5.h"
+
+/*
+ * Per mounted volume there is a directory /sys/kernel/debug/ods5/<device>/:
+ * inodes	the cached inodes with their extent maps, the primary header
+ *		and the chain of loaded extension headers, and the memory
+ *		used for the maps
+ * name_cache	the state of the reverse name cache, see fidpath.c
+ * slow_ops	the slow operation log, see slow.c
+ * The inodes are found with ilookup, one file number after the other, the
+ * seq_file position is the file number. So no lock is held while the
+ * output is produced, and a read continues where the previous one ended,
+ * also with millions of cached inodes.
+ */
+
+static struct dentry *ods5_debugfs_root;
+
+/* one extent, called from ods5_map_extents */
+static void show_extent(void *arg, vms_long count, vms_long lbn)
+{
+	seq_printf(arg, " %u+%u", lbn, count);
+}
+
+/* the next cached inode at or after file number *pos */
+static struct inode *next_cached(struct super_block *sb, loff_t *pos)
+{
+	struct ods5_sb_info *sb_info;
+	struct inode *inode;
+	loff_t ino;
+
+	sb_info = get_sb_info(sb);
+	for (ino = *pos; ino <= sb_info->maxfiles; ino++) {
+		inode = ilookup(sb, ino);
+		if (inode) {
+			if (inode->i_private) {
+				*pos = ino;
+				return inode;
+			}
+			iput(inode);
+		}
+		if ((ino & 1023) == 0)
+			cond_resched();
+	}
+	*pos = ino;
+	return NULL;
+}
+
+static void *inodes_start(struct seq_file *m, loff_t *pos)
+{
+	if (*pos == 0)
+		return SEQ_START_TOKEN;
+	return next_cached(m->private, pos);
+}
+
+static void *inodes_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	if (v != SEQ_START_TOKEN)
+		iput(v);
+	++*pos;
+	return next_cached(m->private, pos);
+}
+
+static void inodes_stop(struct seq_file *m, void *v)
+{
+	if (v && v != SEQ_START_TOKEN)
+		iput(v);
+}
+
+static int inodes_show(struct seq_file *m, void *v)
+{
+	struct inode *inode;
+	struct ods5_fh_info *fh_info;
+	struct ods5_ext_info *ext;
+	size_t bytes;
+	int headers;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_puts(m, "# ino seq size headers map_bytes: lbn+count ... [| ext_fnum: lbn+count ...]\n");
+		return 0;
+	}
+	inode = v;
+	fh_info = inode->i_private;
+	bytes = sizeof *fh_info + sizeof(vms_word) * fh_info->ext.map_inuse;
+	headers = 1;
+	for (ext = READ_ONCE(fh_info->ext.next); ext; ext = READ_ONCE(ext->next)) {
+		bytes += sizeof *ext + sizeof(vms_word) * ext->map_inuse;
+		headers++;
+	}
+	seq_printf(m, "%lu %u %lld %d %zu:", inode->i_ino, fh_info->fid_seq,
+		   i_size_read(inode), headers, bytes);
+	ods5_map_extents(&fh_info->ext.map[0], fh_info->ext.map_inuse,
+			 show_extent, m);
+	/* the loaded extension headers; the chain is only appended to */
+	for (ext = READ_ONCE(fh_info->ext.next); ext; ext = READ_ONCE(ext->next)) {
+		seq_printf(m, " | %u:", ext->ext_fid.num + (ext->ext_fid.nmx << 16));
+		ods5_map_extents(&ext->map[0], ext->map_inuse, show_extent, m);
+	}
+	seq_putc(m, '\n');
+	return 0;
+}
+
+static const struct seq_operations ods5_inodes_sops = {
+	.start = inodes_start,
+	.next = inodes_next,
+	.stop = inodes_stop,
+	.show = inodes_show,
+};
+
+static int ods5_inodes_open(struct inode *inode, struct file *file)
+{
+	int ret;
+
+	ret = seq_open(file, &ods5_inodes_sops);
+	if (ret == 0)
+		((struct seq_file *)file->private_data)->private = inode->i_private;
+	return ret;
+}
+
+static const struct file_operations ods5_inodes_fops = {
+	.owner = THIS_MODULE,
+	.open = ods5_inodes_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = seq_release,
+};
+
+static int name_cache_show(struct seq_file *m, void *v)
+{
+	ods5_name_cache_show(get_sb_info(m->private), m);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(name_cache);
+
+static int slow_ops_show(struct seq_file *m, void *v)
+{
+	ods5_slow_show(get_sb_info(m->private), m);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(slow_ops);
+
+void ods5_debugfs_register(struct super_block *sb)
+{
+	struct ods5_sb_info *sb_info;
+	struct dentry *dir;
+
+	sb_info = get_sb_info(sb);
+	if (IS_ERR_OR_NULL(ods5_debugfs_root))
+		return;
+	dir = debugfs_create_dir(sb->s_id, ods5_debugfs_root);
+	if (IS_ERR(dir))
+		return;
+	debugfs_create_file("inodes", 0400, dir, sb, &ods5_inodes_fops);
+	debugfs_create_file("name_cache", 0400, dir, sb, &name_cache_fops);
+	debugfs_create_file("slow_ops", 0400, dir, sb, &slow_ops_fops);
+	sb_info->debugfs = dir;
+}
+
+void ods5_debugfs_unregister(struct super_block *sb)
+{
+	struct ods5_sb_info *sb_info;
+
+	sb_info = get_sb_info(sb);
+	debugfs_remove_recursive(sb_info->debugfs);
+	sb_info->debugfs = NULL;
+}
+
+void ods5_debugfs_init(void)
+{
+	ods5_debugfs_root = debugfs_create_dir("ods5", NULL);
+}
+
+void ods5_debugfs_exit(void)
+{
+	debugfs_remove_recursive(ods5_debugfs_root);
+}
@@ -23,8 +23,7 @@
 
 #include "./ods5_fs.h"
 #include "./ods5.h"
-
-#define NO_MORE_RECORDS ((vms_word)-1)
+#include "./ods5_trace.h"
 
 static int ucs_to_utf(unsigned char *utf8, unsigned int utf8len, unsigned char *name, vms_byte namelen) {
 	int l, m, n;
@@ -59,6 +58,62 @@ int ods5_isl_to_utf(unsigned char *utf8, unsigned int utf8len, unsigned char *na
 	return l;
 }
 
+/*
+ * Format the name of a directory record as readdir shows it: converted
+ * according to the utf8 option and with the version appended. The buffer
+ * should have ODS5_FN_STRING_SIZE*3 bytes, returns the length of the name.
+ */
+int ods5_dir_name(struct ods5_sb_info *sb_info, struct ods5_dir *dir,
+		  vms_word version, char *fn, unsigned int fnsize) {
+	vms_long fl;
+	int ucs2;
+
+	ucs2 = dir->flags.nametype==DIR_UCS2;
+	if (sb_info->utf8) {
+		if (ucs2) {
+			fl = ucs_to_utf(fn,fnsize,dir->name,dir->namecount);
+			if (fl) {
+				ods5_debug(2, "name: %s\n", fn);
+			} else {
+				ods5_debug(1, "%s\n", "ucs_to_utf failed.");
+			}
+		} else if (dir->flags.nametype==DIR_ISL1) {
+			fl = ods5_isl_to_utf(fn,fnsize,dir->name,dir->namecount);
+			if (fl) {
+				ods5_debug(2, "name: %s\n", fn);
+			} else {
+				ods5_debug(1, "%s\n", "isl_to_utf failed.");
+			}
+		} else {
+			memcpy(fn, dir->name, dir->namecount);
+			fl = dir->namecount;
+		}
+	} else {
+		if (ucs2) {
+			int i;
+			fl= i= 0;
+			while (i<dir->namecount) {
+				if (dir->name[i+1]==0)
+					fn[fl++]= dir->name[i];
+				else
+					fl+= sprintf (&fn[fl], "?%02X%02X", (unsigned char)dir->name[i+1], (unsigned char)dir->name[i]);
+				i+= 2;
+			}
+		} else {
+			memcpy(fn, dir->name, dir->namecount);
+			fl = dir->namecount;
+		}
+	}
+
+	if (sb_info->dotversion)
+		fn[fl] = '.';
+	else
+		fn[fl] = ';';
+	fl++;
+	fl += sprintf(&fn[fl], "%d", version);
+	return fl;
+}
+
 static int ods5_readdir(struct file *file, struct dir_context *ctx) {
 	struct inode *inode;
 	unsigned long ino;
@@ -66,13 +121,14 @@ static int ods5_readdir(struct file *file, struct dir_context *ctx) {
 	vms_long lbn, unused;
 	struct ods5_dir *dir;
 	struct ods5_dirent *dirval;
-	struct buffer_head *bh;
-	vms_long iopos;
+	struct ods5_mblk mb;
 	char *block;
 	vms_long fnoff;	/* file name offset */
 	vms_long vfoff;	/* version entry aka value field offset */
 	struct ods5_sb_info *sb_info;
 	loff_t pos=0; /* gcc can't figure out that it IS correctly initialized */
+	int emitted;
+	struct ods5_slow_op so;
 
 	/* switch with loff_t seems to require a libc function */
 	if (ctx->pos>2)
@@ -99,17 +155,17 @@ static int ods5_readdir(struct file *file, struct dir_context *ctx) {
 
 	vbn = (pos >> ODS5_BLOCK_SHIFT) + 1;
 	ods5_debug(2, "pos: %Ld, vbn: %d\n", pos, vbn);
+	ods5_slow_start(inode->i_sb, inode, &so);
 	if (!mapvbn(inode->i_sb, inode, vbn, &lbn, &unused))
 		return -EBADF;
 
-	/* read the directory vbn, iopos will contain the offset to the vbn */
+	/* read the directory vbn */
 	sb_info = get_sb_info(inode->i_sb);
-	bh = ods5_bread(inode->i_sb, lbn, &iopos);
-	if (bh == NULL) {
-		ods5_debug(1, "ods5_bread of lbn %d failed\n", lbn);
+	block = ods5_mread(inode->i_sb, lbn, &mb);
+	if (block == NULL) {
+		ods5_debug(1, "ods5_mread of lbn %d failed\n", lbn);
 		return -EIO;
 	}
-	block = bh->b_data + iopos;
 
 	/*
 	 * Derive the filename and value field offsets within the vbn;
@@ -119,7 +175,7 @@ static int ods5_readdir(struct file *file, struct dir_context *ctx) {
 	fnoff = pos & (ODS5_BLOCK_SIZE - 1);
 	vfoff = fnoff & ~1;
 	if (*(vms_word *) (block + vfoff) == NO_MORE_RECORDS)
-		return brelse(bh), 0;
+		return ods5_mrelease(&mb), 0;
 
 	if (fnoff != vfoff) {
 		fnoff = 0;
@@ -136,10 +192,10 @@ static int ods5_readdir(struct file *file, struct dir_context *ctx) {
 	dirval = (struct ods5_dirent *)(block + vfoff);
 
 	/* if possible, process one ODS5 directory disk block */
+	emitted = 0;
 	for (; ; ) {
 		char fn[ODS5_FN_STRING_SIZE*3];
 		vms_long fl;
-		int ucs2;
 
 		ods5_debug(2, "fnoff: %d, vfoff: %d\n", fnoff, vfoff);
 		ods5_debug(2, "size: %d\n", dir->size);
@@ -171,52 +227,17 @@ static int ods5_readdir(struct file *file, struct dir_context *ctx) {
 		}
 
 		/* fill in the vfs dirent */
-		ucs2 = dir->flags.nametype==DIR_UCS2;
-		if (sb_info->utf8) {
-			if (ucs2) {
-				fl = ucs_to_utf(fn,sizeof fn,dir->name,dir->namecount);
-				if (fl) {
-					ods5_debug(2, "name: %s\n", fn);
-				} else {
-					ods5_debug(1, "%s\n", "ucs_to_utf failed.");
-				}
-			} else if (dir->flags.nametype==DIR_ISL1) {
-				fl = ods5_isl_to_utf(fn,sizeof fn,dir->name,dir->namecount);
-				if (fl) {
-					ods5_debug(2, "name: %s\n", fn);
-				} else {
-					ods5_debug(1, "%s\n", "isl_to_utf failed.");
-				}
-			} else {
-				memcpy(fn, dir->name, dir->namecount);
-				fl = dir->namecount;
-			}
-		} else {
-			if (ucs2) {
-				int i;
-				fl= i= 0;
-				while (i<dir->namecount) {
-					if (dir->name[i+1]==0)
-						fn[fl++]= dir->name[i];
-					else
-						fl+= sprintf (&fn[fl], "?%02X%02X", (unsigned char)dir->name[i+1], (unsigned char)dir->name[i]);
-					i+= 2;
-				}
-			} else {
-				memcpy(fn, dir->name, dir->namecount);
-				fl = dir->namecount;
-			}
-		}
-
-		if (sb_info->dotversion)
-			fn[fl] = '.';
-		else
-			fn[fl] = ';';
-		fl++;
-		fl += sprintf(&fn[fl], "%d", dirval->version);
+		fl = ods5_dir_name(sb_info, dir, dirval->version, fn, sizeof fn);
 		ods5_debug(2, "fn: '%s', fl: %d\n", fn, fl);
-		if (!dir_emit(ctx, fn, fl, ino, DT_UNKNOWN))
-			return brelse(bh), 1;
+		if (!dir_emit(ctx, fn, fl, ino, DT_UNKNOWN)) {
+			trace_ods5_readdir(inode, vbn, pos, ctx->pos, emitted);
+			ods5_count(sb_info, ODS5_ST_READDIR_ENTRIES, emitted);
+			ods5_slow_end(inode->i_sb, inode, &so, ODS5_SLOW_READDIR,
+				      inode->i_ino, file->f_path.dentry->d_name.name,
+				      file->f_path.dentry->d_name.len, 1);
+			return ods5_mrelease(&mb), 1;
+		}
+		emitted++;
 
 		if (dirval[1].version == NO_MORE_RECORDS) {
 			/* no more entries in this vbn, let pos point to next vbn */
@@ -238,12 +259,19 @@ static int ods5_readdir(struct file *file, struct dir_context *ctx) {
 		}
 	}
 	ods5_debug(2, "return pos: %Ld\n", ctx->pos);
-	brelse(bh);
+	trace_ods5_readdir(inode, vbn, pos, ctx->pos, emitted);
+	ods5_count(sb_info, ODS5_ST_READDIR_BLOCKS, 1);
+	ods5_count(sb_info, ODS5_ST_READDIR_ENTRIES, emitted);
+	ods5_slow_end(inode->i_sb, inode, &so, ODS5_SLOW_READDIR, inode->i_ino,
+		      file->f_path.dentry->d_name.name,
+		      file->f_path.dentry->d_name.len, 1);
+	ods5_mrelease(&mb);
 	return 2;
 }
 
 struct file_operations ods5_dir_operations = {
 	.read = generic_read_dir,
 	.iterate = ods5_readdir,
+	.unlocked_ioctl = ods5_ioctl,
 	.llseek = default_llseek,
 };
@@ -0,0 +1,92 @@
+/*
+ * linux/fs/ods5/export.c
+ *
+ * This file is part of the OpenVMS ODS5 file system for Linux.
+ * Copyright (C) 2017 Hartmut Becker.
+ *
+ * The OpenVMS ODS5 file system for Linux is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The OpenVMS ODS5 file system for Linux is distributed in the hope that it
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/fs.h>
+#include <linux/exportfs.h>
+
+#include "./ods5_fs.h"
+#include "./ods5.h"
+
+/*
+ * NFS export and name_to_handle_at/open_by_handle_at.
+ * The inode number is the file number of the FID, (nmx << 16) + num, and
+ * i_generation is set to the sequence number of the FID, so the generic
+ * FILEID_INO32_GEN handle (ino, generation) is exactly the FID; with a
+ * parent, FILEID_INO32_GEN_PARENT, the parent's FID follows. Decoding a
+ * handle is an ods5_iget, which reads the file header (if the inode isn't
+ * cached) and checks the sequence number, there is no path walk.
+ * A handle of a deleted file fails the sequence number check: ESTALE.
+ */
+
+static struct inode *ods5_nfs_get_inode(struct super_block *sb, u64 ino,
+					u32 generation)
+{
+	struct inode *inode;
+
+	ods5_debug(2, "ino: %llu, generation: %u\n", ino, generation);
+	if (ino == 0 || ino > get_sb_info(sb)->maxfiles)
+		return ERR_PTR(-ESTALE);
+	inode = ods5_iget(sb, ino, generation);
+	if (!inode)
+		return ERR_PTR(-ESTALE);
+	return inode;
+}
+
+static struct dentry *ods5_fh_to_dentry(struct super_block *sb,
+					struct fid *fid, int fh_len,
+					int fh_type)
+{
+	return generic_fh_to_dentry(sb, fid, fh_len, fh_type,
+				    ods5_nfs_get_inode);
+}
+
+static struct dentry *ods5_fh_to_parent(struct super_block *sb,
+					struct fid *fid, int fh_len,
+					int fh_type)
+{
+	return generic_fh_to_parent(sb, fid, fh_len, fh_type,
+				    ods5_nfs_get_inode);
+}
+
+/* the parent directory is in the backlink of the file header */
+static struct dentry *ods5_get_parent(struct dentry *child)
+{
+	struct ods5_fh_info *fh_info;
+	struct inode *inode;
+	unsigned long ino;
+
+	fh_info = (struct ods5_fh_info *)d_inode(child)->i_private;
+	ino = fh_info->backlink.num + (fh_info->backlink.nmx << 16);
+	ods5_debug(2, "child ino: %lu, backlink: (%lu,%d,%d)\n",
+		   d_inode(child)->i_ino, ino, fh_info->backlink.seq,
+		   fh_info->backlink.rvn);
+	if (ino == 0)
+		return ERR_PTR(-ENOENT);
+	inode = ods5_iget(child->d_sb, ino, fh_info->backlink.seq);
+	if (!inode)
+		return ERR_PTR(-ESTALE);
+	return d_obtain_alias(inode);
+}
+
+const struct export_operations ods5_export_ops = {
+	.fh_to_dentry = ods5_fh_to_dentry,
+	.fh_to_parent = ods5_fh_to_parent,
+	.get_parent = ods5_get_parent,
+};
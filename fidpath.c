@@ -0,0 +1,375 @@
+/*
+ * linux/fs/ods5/fidpath.c
+ *
+ * This file is part of the OpenVMS ODS5 file system for Linux.
+ * Copyright (C) 2017 Hartmut Becker.
+ *
+ * The OpenVMS ODS5 file system for Linux is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The OpenVMS ODS5 file system for Linux is distributed in the hope that it
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/capability.h>
+#include <linux/fs.h>
+#include <linux/sched/signal.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+
+#include "./ods5_fs.h"
+#include "./ods5.h"
+
+/*
+ * FID to path.
+ * Each file header has a backlink, the FID of the directory which has the
+ * (primary) entry of the file. Following the backlinks up to the MFD gives
+ * the directories, for the names the entry of each FID is searched in its
+ * backlink directory. That is a scan of the directory, so all the entries
+ * seen on the way are remembered in a reverse name cache: child FID to
+ * parent FID and name. Then resolving the FIDs of a directory tree scans
+ * each directory about once, and not once per file.
+ * The cache is per volume, a hash on the file number with an LRU list,
+ * limited to ODS5_NAME_CACHE_MAX entries. The entries are also charged to
+ * the cache budget of the volume, see cache.c, which can drop them, too;
+ * its cache_lock protects the name cache.
+ */
+
+/* directories deeper than that are most likely a backlink loop */
+#define FIDPATH_MAXDEPTH 255
+
+typedef struct ods5_name_ent {
+	struct hlist_node hash;
+	struct list_head lru;
+	struct ods5_cache_ent ce;
+	struct ods5_fid fid;
+	struct ods5_fid parent;
+	vms_word namelen;
+	char name[];
+} _ODS5_NAME_ENT;
+
+static inline vms_long fid_ino(struct ods5_fid fid)
+{
+	return fid.num + (fid.nmx << 16);
+}
+
+void ods5_name_cache_init(struct ods5_sb_info *sb_info)
+{
+	hash_init(sb_info->name_hash);
+	INIT_LIST_HEAD(&sb_info->name_lru);
+	sb_info->name_count = 0;
+}
+
+void ods5_name_cache_free(struct ods5_sb_info *sb_info)
+{
+	struct ods5_name_ent *ne, *tmp;
+
+	list_for_each_entry_safe(ne, tmp, &sb_info->name_lru, lru)
+		kfree(ne);
+	INIT_LIST_HEAD(&sb_info->name_lru);
+	sb_info->name_count = 0;
+}
+
+/* for debugfs: the fill level and the hash chains */
+void ods5_name_cache_show(struct ods5_sb_info *sb_info, struct seq_file *m)
+{
+	struct ods5_name_ent *ne;
+	vms_long used, longest, n;
+	int bkt;
+
+	used = longest = 0;
+	spin_lock(&sb_info->cache_lock);
+	for (bkt = 0; bkt < HASH_SIZE(sb_info->name_hash); bkt++) {
+		n = 0;
+		hlist_for_each_entry(ne, &sb_info->name_hash[bkt], hash)
+			n++;
+		if (n)
+			used++;
+		if (n > longest)
+			longest = n;
+	}
+	n = sb_info->name_count;
+	spin_unlock(&sb_info->cache_lock);
+	seq_printf(m, "entries: %u/%u\n", n, ODS5_NAME_CACHE_MAX);
+	seq_printf(m, "buckets: %u/%lu, longest chain: %u\n", used,
+		   (unsigned long)HASH_SIZE(sb_info->name_hash), longest);
+}
+
+/* with cache_lock: remove the entry from the name cache and free it */
+void ods5_name_cache_drop(struct ods5_sb_info *sb_info,
+			  struct ods5_cache_ent *ce)
+{
+	struct ods5_name_ent *ne;
+
+	ne = container_of(ce, struct ods5_name_ent, ce);
+	__ods5_cache_del(sb_info, ce);
+	hash_del(&ne->hash);
+	list_del(&ne->lru);
+	sb_info->name_count--;
+	kfree(ne);
+}
+
+/* look up fid, a zero seq matches any; on a hit, copy out parent and name */
+static int name_cache_get(struct ods5_sb_info *sb_info, struct ods5_fid fid,
+			  struct ods5_fid *parent, char *name, vms_word *namelen)
+{
+	struct ods5_name_ent *ne;
+	vms_long ino;
+	int found;
+
+	ino = fid_ino(fid);
+	found = 0;
+	spin_lock(&sb_info->cache_lock);
+	hash_for_each_possible(sb_info->name_hash, ne, hash, ino) {
+		if (fid_ino(ne->fid) != ino)
+			continue;
+		if (fid.seq && ne->fid.seq != fid.seq)
+			continue;
+		*parent = ne->parent;
+		*namelen = ne->namelen;
+		memcpy(name, ne->name, ne->namelen);
+		list_move(&ne->lru, &sb_info->name_lru);
+		__ods5_cache_add(sb_info, &ne->ce, 0);
+		found = 1;
+		break;
+	}
+	spin_unlock(&sb_info->cache_lock);
+	ods5_count(sb_info, found ? ODS5_ST_NAME_HIT : ODS5_ST_NAME_MISS, 1);
+	return found;
+}
+
+static void name_cache_put(struct ods5_sb_info *sb_info, struct ods5_fid fid,
+			   struct ods5_fid parent, char *name, vms_word namelen)
+{
+	struct ods5_name_ent *ne, *old;
+	vms_long ino;
+
+	ne = kmalloc(sizeof *ne + namelen, GFP_KERNEL);
+	if (!ne)
+		return;
+	ne->fid = fid;
+	ne->parent = parent;
+	ne->namelen = namelen;
+	memcpy(ne->name, name, namelen);
+	INIT_LIST_HEAD(&ne->ce.lru);
+	ne->ce.bytes = 0;
+	ne->ce.type = ODS5_CACHE_NAME;
+
+	ino = fid_ino(fid);
+	spin_lock(&sb_info->cache_lock);
+	hash_for_each_possible(sb_info->name_hash, old, hash, ino) {
+		if (fid_ino(old->fid) == ino && old->fid.seq == fid.seq) {
+			/* already there, it can't have changed */
+			list_move(&old->lru, &sb_info->name_lru);
+			__ods5_cache_add(sb_info, &old->ce, 0);
+			spin_unlock(&sb_info->cache_lock);
+			kfree(ne);
+			return;
+		}
+	}
+	if (sb_info->name_count >= ODS5_NAME_CACHE_MAX) {
+		old = list_last_entry(&sb_info->name_lru, struct ods5_name_ent, lru);
+		ods5_name_cache_drop(sb_info, &old->ce);
+	}
+	hash_add(sb_info->name_hash, &ne->hash, ino);
+	list_add(&ne->lru, &sb_info->name_lru);
+	sb_info->name_count++;
+	__ods5_cache_add(sb_info, &ne->ce, sizeof *ne + namelen);
+	spin_unlock(&sb_info->cache_lock);
+	ods5_cache_trim(sb_info);
+}
+
+/*
+ * Scan the directory with dirfid for the entry of fid. All the entries of
+ * the scanned blocks go into the name cache, the scan stops after the block
+ * with the match. Returns 0 if found, then the name is in fn.
+ */
+static int scan_dir(struct super_block *sb, struct ods5_fid dirfid,
+		    struct ods5_fid fid, char *fn, vms_word *fl)
+{
+	struct ods5_sb_info *sb_info;
+	struct inode *inode;
+	struct ods5_dir *dir;
+	struct ods5_dirent *dirval;
+	struct ods5_mblk mb;
+	char *block;
+	char *name;
+	vms_long vbn, eofvbn;
+	vms_long lbn, unused;
+	vms_long fnoff, vfoff, recend;
+	int found, l;
+
+	sb_info = get_sb_info(sb);
+	inode = ods5_iget(sb, fid_ino(dirfid), dirfid.seq);
+	if (!inode)
+		return -ENOENT;
+	if (!S_ISDIR(inode->i_mode)) {
+		iput(inode);
+		return -ENOTDIR;
+	}
+	name = kmalloc(ODS5_FN_STRING_SIZE*3, GFP_KERNEL);
+	if (!name) {
+		iput(inode);
+		return -ENOMEM;
+	}
+
+	found = -ENOENT;
+	eofvbn = (inode->i_size + ODS5_BLOCK_SIZE - 1) >> ODS5_BLOCK_SHIFT;
+	for (vbn = 1; vbn <= eofvbn && found == -ENOENT; vbn++) {
+		if (fatal_signal_pending(current)) {
+			found = -EINTR;
+			break;
+		}
+		if (!mapvbn(sb, inode, vbn, &lbn, &unused)) {
+			found = -EIO;
+			break;
+		}
+		block = ods5_mread(sb, lbn, &mb);
+		if (block == NULL) {
+			found = -EIO;
+			break;
+		}
+		for (fnoff = 0; fnoff < ODS5_BLOCK_SIZE - sizeof *dir; fnoff = recend) {
+			dir = (struct ods5_dir *)(block + fnoff);
+			if (dir->size == NO_MORE_RECORDS)
+				break;
+			recend = fnoff + dir->size + sizeof dir->size;
+			if (recend > ODS5_BLOCK_SIZE)
+				break;
+			if (dir->flags.type != DIR_FID)
+				continue;
+			vfoff = fnoff + offsetof(struct ods5_dir, name)
+				+ ((dir->namecount + 1) & ~1);
+			for (; vfoff + sizeof *dirval <= recend; vfoff += sizeof *dirval) {
+				dirval = (struct ods5_dirent *)(block + vfoff);
+				l = ods5_dir_name(sb_info, dir, dirval->version,
+						  name, ODS5_FN_STRING_SIZE*3);
+				name_cache_put(sb_info, dirval->fid, dirfid, name, l);
+				if (fid_ino(dirval->fid) == fid_ino(fid)
+				    && (fid.seq == 0 || dirval->fid.seq == fid.seq)) {
+					memcpy(fn, name, l);
+					*fl = l;
+					found = 0;
+				}
+			}
+		}
+		ods5_mrelease(&mb);
+		cond_resched();
+	}
+	kfree(name);
+	iput(inode);
+	return found;
+}
+
+/* the backlink of the file with fid, from its header; fills in a zero seq */
+static int get_backlink(struct super_block *sb, struct ods5_fid *fid,
+			struct ods5_fid *backlink)
+{
+	struct ods5_sb_info *sb_info;
+	struct ods5_fh2 *fh2;
+	struct ods5_mblk mb;
+	struct ods5_fid hfid;
+
+	sb_info = get_sb_info(sb);
+	if (fid_ino(*fid) == 0 || fid_ino(*fid) > sb_info->maxfiles)
+		return -ESTALE;
+	fh2 = ods5_read_fh(sb, fid_ino(*fid), &mb);
+	if (fh2 == NULL)
+		return -EIO;
+	hfid = *fid;
+	if (hfid.seq == 0)
+		hfid.seq = fh2->fid.seq;
+	if (!is_used_fh2(fh2, hfid) || fh2->seg_num != 0) {
+		ods5_mrelease(&mb);
+		return -ESTALE;
+	}
+	*fid = hfid;
+	*backlink = fh2->backlink;
+	ods5_mrelease(&mb);
+	return 0;
+}
+
+long ods5_ioc_fidpath(struct file *filp, unsigned long arg)
+{
+	struct super_block *sb;
+	struct ods5_sb_info *sb_info;
+	struct ods5_fidpath req;
+	struct ods5_fid fid, parent;
+	char *path, *fn;
+	vms_word fl;
+	vms_long pos;
+	int depth;
+	long ret;
+
+	sb = filp->f_path.dentry->d_sb;
+	sb_info = get_sb_info(sb);
+	/* like open_by_handle_at, names of unreadable directories show */
+	if (!capable(CAP_DAC_READ_SEARCH))
+		return -EPERM;
+	if (copy_from_user(&req, (void __user *)arg, sizeof req))
+		return -EFAULT;
+	if (req.flags != 0 || req.spare != 0 || req.fid.rvn > 1)
+		return -EINVAL;
+	ods5_debug(2, "fid: (%d,%d,%d)\n", fid_ino(req.fid), req.fid.seq,
+		   req.fid.rvn);
+
+	path = kmalloc(PATH_MAX + ODS5_FN_STRING_SIZE*3, GFP_KERNEL);
+	if (!path)
+		return -ENOMEM;
+	fn = path + PATH_MAX;
+
+	/* the path is built from the end of the buffer */
+	pos = PATH_MAX - 1;
+	path[pos] = 0;
+	fid = req.fid;
+	fid.rvn = 0;
+	ret = 0;
+	for (depth = 0; fid_ino(fid) != ODS5_MFD_INO; depth++) {
+		if (depth > FIDPATH_MAXDEPTH) {
+			ret = -ELOOP;
+			break;
+		}
+		if (!name_cache_get(sb_info, fid, &parent, fn, &fl)) {
+			ret = get_backlink(sb, &fid, &parent);
+			if (ret)
+				break;
+			if (fid_ino(parent) == 0) {
+				ret = -ENOENT;
+				break;
+			}
+			ret = scan_dir(sb, parent, fid, fn, &fl);
+			if (ret)
+				break;
+		}
+		if (pos < fl + 1) {
+			ret = -ENAMETOOLONG;
+			break;
+		}
+		pos -= fl;
+		memcpy(&path[pos], fn, fl);
+		path[--pos] = '/';
+		fid = parent;
+	}
+	if (ret == 0 && path[pos] == 0)
+		path[--pos] = '/';
+	if (ret == 0) {
+		fl = PATH_MAX - pos;
+		if (req.size < fl)
+			ret = -ERANGE;
+		else if (copy_to_user((void __user *)(unsigned long)req.buffer,
+				      &path[pos], fl))
+			ret = -EFAULT;
+		req.size = fl;
+		if (copy_to_user((void __user *)arg, &req, sizeof req))
+			ret = -EFAULT;
+	}
+	kfree(path);
+	return ret;
+}
@@ -21,25 +21,120 @@
 #include <linux/fs.h>
 #include <linux/blkdev.h>
 #include <asm/uaccess.h>
+#include <linux/uio.h>
 
 #include "./ods5_fs.h"
 #include "./ods5.h"
+#include "./ods5_trace.h"
 
-static ssize_t ods5_read(struct file *file, char *buf, size_t max,
-			 loff_t * offset)
+/*
+ * ODS-5 aware readahead.
+ * The generic readahead doesn't see the retrieval pointers: it doesn't know
+ * that the current extent runs for another few thousand blocks or that the
+ * next one is somewhere else on the disk. Here the window is built from the
+ * mapping: from the first vbn not yet read ahead, the rest of the current
+ * extent, then the first lbns of the next extent(s), until ra_kb is used up.
+ * The window state is kept in the (otherwise unused) f_ra of the file:
+ * start is the first vbn of the window, size the number of vbns and
+ * async_size the distance to the end of the window, at which the next
+ * window is started. So the next window is queued while the current one
+ * still has blocks to read, also across extent boundaries.
+ * At least want vbns are read ahead, that is what the caller reads anyway.
+ */
+static void ods5_readahead(struct file *file, struct inode *inode,
+			   vms_long vbn, vms_long want)
+{
+	struct super_block *sb;
+	struct ods5_sb_info *sb_info;
+	struct file_ra_state *ra;
+	struct blk_plug plug;
+	struct buffer_head *bh;
+	vms_long rablocks, eofvbn, from;
+	vms_long lbn, extent, n;
+	sector_t block, last;
+
+	sb = inode->i_sb;
+	sb_info = get_sb_info(sb);
+	if (sb_info->ra_kb == 0)
+		return;
+	ra = &file->f_ra;
+
+	/* the window is still far enough ahead */
+	if (vbn >= ra->start && vbn + ra->async_size < ra->start + ra->size)
+		return;
+	/* continue an existing window, or start a new one at vbn */
+	from = vbn;
+	if (vbn >= ra->start && vbn < ra->start + ra->size)
+		from = ra->start + ra->size;
+	eofvbn = (inode->i_size + ODS5_BLOCK_SIZE - 1) >> ODS5_BLOCK_SHIFT;
+	if (from > eofvbn)
+		return;
+
+	rablocks = sb_info->ra_kb << (10 - ODS5_BLOCK_SHIFT);
+	if (rablocks < want)
+		rablocks = want;
+	if (rablocks > eofvbn - from + 1)
+		rablocks = eofvbn - from + 1;
+	ods5_debug(3, "vbn: %d, window from: %d, blocks: %d\n", vbn, from,
+		   rablocks);
+
+	ra->start = from;
+	ra->size = 0;
+	blk_start_plug(&plug);
+	while (ra->size < rablocks) {
+		if (!mapvbn(sb, inode, from + ra->size, &lbn, &extent))
+			break;
+		/* the rest of this extent, or what is left of the window */
+		n = extent;
+		if (n > rablocks - ra->size)
+			n = rablocks - ra->size;
+		last = (lbn + n - 1) >> sb_info->ioshifts;
+		for (block = lbn >> sb_info->ioshifts; block <= last; block++) {
+			/* sb_breadahead, but the blocks from disk are counted */
+			bh = sb_getblk(sb, block);
+			if (!buffer_uptodate(bh)) {
+				ods5_iocount(inode, ODS5_IO_DISK, 1);
+				bh_readahead(bh, REQ_RAHEAD);
+			}
+			brelse(bh);
+		}
+		ra->size += n;
+	}
+	blk_finish_plug(&plug);
+	ra->async_size = ra->size >> 1;
+}
+
+/*
+ * Read with a kiocb, which is what io_uring and aio use.
+ * With IOCB_NOWAIT nothing may block on I/O: the mapping is done with the
+ * already loaded retrieval pointers and the data blocks are taken from the
+ * buffer cache only. If an extension header or a data block would need a
+ * read, what is transferred so far is returned, or -EAGAIN, if nothing was
+ * transferred. Then the caller retries without IOCB_NOWAIT, in a context
+ * that can block.
+ */
+static ssize_t __ods5_read_iter(struct kiocb *iocb, struct iov_iter *to)
 {
+	struct file *file;
 	struct inode *inode;
 	loff_t fsize, fpos;
-	size_t fbytes;
+	size_t fbytes, max;
 	vms_long vbn, vbnextends, vbnpos;
 	vms_long lbn, lbnextends;
 	vms_long iopos, iobytes, xbytes;
 	struct buffer_head *bh;
 	char *lbdata;
-	unsigned int not_copied;
+	size_t copied;
+	int sequential;
+	int nowait;
+	int ret;
 
-	ods5_debug(2, "file: %p, buf: %p, max: " FMT_size_t ", *offset: %Ld\n",
-		   file, buf, max, *offset);
+	file = iocb->ki_filp;
+	if (ods5_rms_translated(file_inode(file)))
+		return ods5_rms_read_iter(iocb, to);
+	max = iov_iter_count(to);
+	ods5_debug(2, "file: %p, max: " FMT_size_t ", ki_pos: %Ld, ki_flags: 0x%x\n",
+		   file, max, iocb->ki_pos, iocb->ki_flags);
 
 	/* nothing to read, nothing to do */
 	if (max == 0)
@@ -51,7 +146,7 @@ static ssize_t ods5_read(struct file *file, char *buf, size_t max,
 		return -EINVAL;
 
 	/* do not start after EOF */
-	fpos = *offset;
+	fpos = iocb->ki_pos;
 	fsize = inode->i_size;
 	if (fpos >= fsize)
 		return 0;
@@ -69,21 +164,43 @@ static ssize_t ods5_read(struct file *file, char *buf, size_t max,
 	ods5_debug(2, "vbn: %d, vbnpos: %d, vbnextends: %d\n", vbn, vbnpos,
 		   vbnextends);
 
+	/*
+	 * read ahead only for sequential reads, prev_pos starts with -1;
+	 * a nowait read doesn't start any I/O, the retry will do it
+	 */
+	nowait = (iocb->ki_flags & IOCB_NOWAIT) != 0;
+	sequential = !nowait && (fpos == 0 || fpos == file->f_ra.prev_pos);
+
 	xbytes = 0;
 	iobytes = 0;
 	/* as long as there aren't all bytes transfered */
 	while (xbytes < fbytes) {
+		if (sequential)
+			ods5_readahead(file, inode, vbn, vbnextends);
 		/* get the lbn and the extend size */
-		if (!mapvbn(inode->i_sb, inode, vbn, &lbn, &lbnextends))
+		if (nowait) {
+			ret = mapvbn_nowait(inode->i_sb, inode, vbn, &lbn, &lbnextends);
+			if (ret == -EAGAIN)
+				goto again;
+		} else
+			ret = mapvbn(inode->i_sb, inode, vbn, &lbn, &lbnextends);
+		if (!ret)
 			return 0;
 		/* don't read more lbns than necessary */
 		if (lbnextends > vbnextends)
 			lbnextends = vbnextends;
 		/* read the block */
-		bh = ods5_bread(inode->i_sb, lbn, &iopos);
-		if (bh == NULL) {
-			ods5_debug(1, "ods5_bread of lbn %d failed\n", lbn);
-			return -EIO;
+		if (nowait) {
+			bh = ods5_bread_cached(inode->i_sb, lbn, &iopos);
+			if (bh == NULL)
+				goto again;
+			ods5_iocount(inode, ODS5_IO_CACHED, 1);
+		} else {
+			bh = ods5_bread_io(inode, lbn, &iopos);
+			if (bh == NULL) {
+				ods5_debug(1, "ods5_bread of lbn %d failed\n", lbn);
+				return -EIO;
+			}
 		}
 		/* iopos == offset of lbdata in bh->b_data */
 		lbdata = bh->b_data + iopos;
@@ -96,17 +213,19 @@ static ssize_t ods5_read(struct file *file, char *buf, size_t max,
 		/* limit to what is needed */
 		if (iobytes > (fbytes - xbytes))
 			iobytes = fbytes - xbytes;
-		not_copied =
-		    copy_to_user(&buf[xbytes], &lbdata[vbnpos], iobytes);
+		copied = copy_to_iter(&lbdata[vbnpos], iobytes, to);
 		brelse(bh);
-		if (not_copied != 0) {
-			ods5_debug(2, "data at %p, iobytes: %d, not copied: %d\n",
-				   lbdata, iobytes, not_copied);
-			return -EFAULT;
+		if (copied != iobytes) {
+			ods5_debug(2, "data at %p, iobytes: %d, copied: " FMT_size_t "\n",
+				   lbdata, iobytes, copied);
+			xbytes += copied;
+			if (xbytes == 0)
+				return -EFAULT;
+			break;
 		}
 
 		ods5_debug(2,
-		    "copy_to_user, &buf[%d], vbnpos: %d, iobytes: %d\n",
+		    "copy_to_iter, xbytes: %d, vbnpos: %d, iobytes: %d\n",
 		     xbytes, vbnpos, iobytes);
 		/* update transferred bytes, position to next vbn in file */
 		xbytes += iobytes;
@@ -115,13 +234,71 @@ static ssize_t ods5_read(struct file *file, char *buf, size_t max,
 		vbnpos += iobytes;
 		vbnpos &= (ODS5_BLOCK_SIZE - 1);
 	}			/* while xbytes<fbytes */
-	*offset += fbytes;
-	ods5_debug(2, "return, fbytes: " FMT_size_t "\n", fbytes);
-	return fbytes;
+	iocb->ki_pos += xbytes;
+	file->f_ra.prev_pos = iocb->ki_pos;
+	ods5_debug(2, "return, xbytes: %d\n", xbytes);
+	return xbytes;
+
+again:
+	ods5_debug(3, "nowait, not cached: vbn %d, xbytes: %d\n", vbn, xbytes);
+	if (xbytes == 0)
+		return -EAGAIN;
+	iocb->ki_pos += xbytes;
+	file->f_ra.prev_pos = iocb->ki_pos;
+	return xbytes;
+}
+
+static ssize_t ods5_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct inode *inode;
+	struct dentry *dentry;
+	struct ods5_slow_op so;
+	loff_t pos;
+	size_t count;
+	ssize_t ret;
+
+	inode = file_inode(iocb->ki_filp);
+	pos = iocb->ki_pos;
+	count = iov_iter_count(to);
+	ods5_slow_start(inode->i_sb, inode, &so);
+	ret = __ods5_read_iter(iocb, to);
+	trace_ods5_read_iter(inode, pos, count, ret);
+	if (ret > 0)
+		ods5_iocount(inode, ODS5_IO_BYTES, ret);
+	if (so.start) {
+		dentry = iocb->ki_filp->f_path.dentry;
+		/* the blocks touched */
+		ods5_slow_end(inode->i_sb, inode, &so, ODS5_SLOW_READ,
+			      inode->i_ino, dentry->d_name.name,
+			      dentry->d_name.len, ret > 0 ?
+			      ((pos + ret - 1) >> ODS5_BLOCK_SHIFT)
+			      - (pos >> ODS5_BLOCK_SHIFT) + 1 : 0);
+	}
+	return ret;
+}
+
+/*
+ * Announce that ods5_read_iter handles IOCB_NOWAIT. For a translated file
+ * get the size right, before it is used for a seek. From now on the reads
+ * are accounted, see iostat.c.
+ */
+static int ods5_file_open(struct inode *inode, struct file *filp)
+{
+	struct ods5_rms *rms;
+
+	if (ods5_rms_translated(inode)) {
+		rms = ods5_rms_index(inode);
+		if (IS_ERR(rms))
+			return PTR_ERR(rms);
+	}
+	filp->f_mode |= FMODE_NOWAIT;
+	ods5_iostat_open(inode);
+	return generic_file_open(inode, filp);
 }
 
 struct file_operations ods5_file_operations = {
-	.read = ods5_read,
+	.open = ods5_file_open,
+	.read_iter = ods5_read_iter,
 	.unlocked_ioctl = ods5_ioctl,
 	.llseek = default_llseek,
 };
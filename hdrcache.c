@@ -0,0 +1,160 @@
+/*
+ * linux/fs/ods5/hdrcache.c
+ *
+ * This file is part of the OpenVMS ODS5 file system for Linux.
+ * Copyright (C) 2017 Hartmut Becker.
+ *
+ * The OpenVMS ODS5 file system for Linux is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The OpenVMS ODS5 file system for Linux is distributed in the hope that it
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/fs.h>
+#include <linux/hash.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#include "./ods5_fs.h"
+#include "./ods5.h"
+
+/*
+ * Decoded file header cache.
+ * ods5_read_inode decodes the file header into an ods5_hdr: mode, UIC,
+ * size, times, link count, the record attributes, the backlink and the
+ * primary map. With the header cache, the ods5_hdr is kept by FID after the
+ * inode is evicted; when the inode is read again, it is filled from there,
+ * without reading the header and without verifying its checksum again. The
+ * volume is read-only, a header doesn't change, and with the sequence
+ * number in the key a reused file number doesn't match.
+ * Headers with more than ODS5_HDR_MAXMAP map words are not cached. An entry
+ * is much smaller than an inode; the entries are charged to the cache
+ * budget of the volume, see cache.c, which also drops them, and cache_lock
+ * protects the hash.
+ */
+
+typedef struct ods5_hdr_ent {
+	struct hlist_node hash;
+	struct ods5_cache_ent ce;
+	unsigned long ino;
+	struct ods5_hdr hdr;		/* with map_inuse map words */
+} _ODS5_HDR_ENT;
+
+static inline vms_long hdr_bytes(vms_byte map_inuse)
+{
+	return offsetof(struct ods5_hdr, map) + sizeof(vms_word) * map_inuse;
+}
+
+void ods5_hdr_cache_init(struct ods5_sb_info *sb_info)
+{
+	/* without the hash the headers are just not cached */
+	sb_info->hdr_hash = kvcalloc(1 << ODS5_HDR_HASH_BITS,
+				     sizeof *sb_info->hdr_hash, GFP_KERNEL);
+	sb_info->hdr_count = 0;
+}
+
+void ods5_hdr_cache_free(struct ods5_sb_info *sb_info)
+{
+	struct ods5_hdr_ent *he;
+	struct hlist_node *tmp;
+	int i;
+
+	if (!sb_info->hdr_hash)
+		return;
+	for (i = 0; i < 1 << ODS5_HDR_HASH_BITS; i++)
+		hlist_for_each_entry_safe(he, tmp, &sb_info->hdr_hash[i], hash)
+			kfree(he);
+	kvfree(sb_info->hdr_hash);
+	sb_info->hdr_hash = NULL;
+}
+
+/* with cache_lock: remove the entry from the hash and free it */
+void ods5_hdr_drop(struct ods5_sb_info *sb_info, struct ods5_cache_ent *ce)
+{
+	struct ods5_hdr_ent *he;
+
+	he = container_of(ce, struct ods5_hdr_ent, ce);
+	__ods5_cache_del(sb_info, ce);
+	hlist_del(&he->hash);
+	sb_info->hdr_count--;
+	kfree(he);
+}
+
+static struct hlist_head *hdr_bucket(struct ods5_sb_info *sb_info,
+				     unsigned long ino)
+{
+	return &sb_info->hdr_hash[hash_long(ino, ODS5_HDR_HASH_BITS)];
+}
+
+/* the decoded header of ino with seq, copied into hdr; 0 if not cached */
+int ods5_hdr_get(struct ods5_sb_info *sb_info, unsigned long ino,
+		 vms_word seq, struct ods5_hdr *hdr)
+{
+	struct ods5_hdr_ent *he;
+	int found;
+
+	if (!sb_info->hdr_hash)
+		return 0;
+	found = 0;
+	spin_lock(&sb_info->cache_lock);
+	hlist_for_each_entry(he, hdr_bucket(sb_info, ino), hash) {
+		if (he->ino != ino || he->hdr.seq != seq)
+			continue;
+		memcpy(hdr, &he->hdr, hdr_bytes(he->hdr.map_inuse));
+		__ods5_cache_add(sb_info, &he->ce, 0);
+		found = 1;
+		break;
+	}
+	spin_unlock(&sb_info->cache_lock);
+	ods5_count(sb_info, found ? ODS5_ST_HDR_HIT : ODS5_ST_HDR_MISS, 1);
+	return found;
+}
+
+void ods5_hdr_put(struct ods5_sb_info *sb_info, unsigned long ino,
+		  struct ods5_hdr *hdr)
+{
+	struct ods5_hdr_ent *he, *old;
+	struct hlist_node *tmp;
+	vms_long bytes;
+
+	if (!sb_info->hdr_hash || hdr->map_inuse > ODS5_HDR_MAXMAP)
+		return;
+	bytes = offsetof(struct ods5_hdr_ent, hdr) + hdr_bytes(hdr->map_inuse);
+	he = kmalloc(bytes, GFP_NOFS);
+	if (!he)
+		return;
+	he->ino = ino;
+	memcpy(&he->hdr, hdr, hdr_bytes(hdr->map_inuse));
+	INIT_LIST_HEAD(&he->ce.lru);
+	he->ce.bytes = 0;
+	he->ce.type = ODS5_CACHE_HEADER;
+
+	spin_lock(&sb_info->cache_lock);
+	hlist_for_each_entry_safe(old, tmp, hdr_bucket(sb_info, ino), hash) {
+		if (old->ino != ino)
+			continue;
+		if (old->hdr.seq == hdr->seq) {
+			/* read twice in parallel */
+			spin_unlock(&sb_info->cache_lock);
+			kfree(he);
+			return;
+		}
+		/* the file number was reused */
+		ods5_hdr_drop(sb_info, &old->ce);
+	}
+	hlist_add_head(&he->hash, hdr_bucket(sb_info, ino));
+	sb_info->hdr_count++;
+	__ods5_cache_add(sb_info, &he->ce, bytes);
+	spin_unlock(&sb_info->cache_lock);
+	ods5_cache_trim(sb_info);
+}
@@ -27,13 +27,14 @@
 
 #include "./ods5_fs.h"
 #include "./ods5.h"
+#include "./ods5_trace.h"
 
 /*
  * Look up the lbn for a given vbn in the mapping information, aka
- * retrieval pointers
+ * retrieval pointers; the decoded pointers are counted in *ptrs
  */
 static int lbn_lookup(union ods5_fm2 *fm2, vms_byte map_inuse, vms_long vbn, vms_long * xlbn,
-		  vms_long * extent, vms_long * sum)
+		  vms_long * extent, vms_long * sum, int *ptrs)
 {
 	vms_long lbn;
 	vms_long count;
@@ -43,6 +44,7 @@ static int lbn_lookup(union ods5_fm2 *fm2, vms_byte map_inuse, vms_long vbn, vms
 	lbn = count = 0;
 	wp = (vms_word *) fm2;
 	for (i = 0; i < map_inuse;) {
+		(*ptrs)++;
 		switch (fm2->format0.format) {
 		case 0:
 			ods5_debug(3, "0x%04x\n", wp[i]);
@@ -104,11 +106,62 @@ static int lbn_lookup(union ods5_fm2 *fm2, vms_byte map_inuse, vms_long vbn, vms
 	return 0;
 }
 
+/*
+ * Walk through the retrieval pointers, calling fn (if not NULL) with count
+ * and lbn of each extent; placement pointers (format 0) are skipped.
+ * Return the number of extents.
+ */
+int ods5_map_extents(union ods5_fm2 *fm2, vms_byte map_inuse,
+		     void (*fn)(void *arg, vms_long count, vms_long lbn),
+		     void *arg)
+{
+	vms_long count, lbn;
+	vms_word *wp;
+	int i, n;
+
+	wp = (vms_word *) fm2;
+	for (i = n = 0; i < map_inuse; fm2 = (union ods5_fm2 *) & wp[i]) {
+		switch (fm2->format0.format) {
+		case 0:
+			i += 1;
+			continue;
+		case 1:
+			count = fm2->format1.count + 1;
+			lbn = (fm2->format1.highlbn << 16) + fm2->format1.lowlbn;
+			i += 2;
+			break;
+		case 2:
+			count = fm2->format2.count + 1;
+			lbn = fm2->format2.lbn;
+			i += 3;
+			break;
+		default:
+			count = (fm2->format3.highcount << 16) +
+				fm2->format3.lowcount + 1;
+			lbn = fm2->format3.lbn;
+			i += 4;
+			break;
+		}
+		/* a pointer must not exceed the map */
+		if (i > map_inuse)
+			break;
+		if (fn)
+			fn(arg, count, lbn);
+		n++;
+	}
+	return n;
+}
+
 /*
  * Map a file vbn (1,2,...) to a disk lbn (0,1,...) plus extent
+ * With nowait, only the already loaded mapping information is used: if an
+ * extension header has to be read, -EAGAIN is returned instead.
+ * The extension headers walked are counted in *walked, the pointers decoded
+ * in *ptrs.
  */
-int mapvbn(struct super_block *sb, struct inode *inode, vms_long vbn,
-	   vms_long * lbn, vms_long * extent)
+static int map_walk(struct super_block *sb, struct inode *inode, vms_long vbn,
+		    vms_long * lbn, vms_long * extent, int nowait, int *walked,
+		    int *ptrs)
 {
 	vms_long sum;
 	struct ods5_fh_info *fh_info;
@@ -117,10 +170,10 @@ int mapvbn(struct super_block *sb, struct inode *inode, vms_long vbn,
 	fh_info = (struct ods5_fh_info *)inode->i_private;
 	
 	if (lbn_lookup(&fh_info->ext.map[0], fh_info->ext.map_inuse,
-		       vbn, lbn, extent, &sum))
+		       vbn, lbn, extent, &sum, ptrs))
 	    return 1;
        else {
-	       struct buffer_head *bh;
+	       struct ods5_mblk mb;
 	       struct ods5_fh2 *fh2;
 	       struct ods5_ext_info *ext, *next;
 	       int fnum;
@@ -133,8 +186,9 @@ int mapvbn(struct super_block *sb, struct inode *inode, vms_long vbn,
 		       ods5_debug(2, "next ext %p\n", ext->next);
 		       if (ext->next!=NULL) {
 			       ext = ext->next;
+			       (*walked)++;
 			       if (lbn_lookup(&ext->map[0], ext->map_inuse,
-					      vbn, lbn, extent, &sum))
+					      vbn, lbn, extent, &sum, ptrs))
 				       return 1;
 			       fnum = ext->ext_fid.num + (ext->ext_fid.nmx << 16);
 			       ods5_debug(2, "extension header %d\n", fnum);
@@ -142,15 +196,17 @@ int mapvbn(struct super_block *sb, struct inode *inode, vms_long vbn,
 				       return 0;
 			       continue;
 		       }
-		       bh = ods5_read_fh(inode->i_sb, fnum, &fh2);
-		       if (bh == NULL) {
+		       if (nowait)
+			       return -EAGAIN;
+		       fh2 = ods5_read_fh(inode->i_sb, fnum, &mb);
+		       if (fh2 == NULL) {
 			       ods5_debug(1, "ods5_read_fh for ino %d failed\n", fnum);
 			       return 0;
 		       }
 		       next = kmalloc (sizeof *next+sizeof(vms_word)*fh2->map_inuse, GFP_NOFS);
 		       ods5_debug(2, "kmalloc next %p\n", next);
 		       if (next==NULL) {
-			       brelse (bh);
+			       ods5_mrelease (&mb);
 			       return 0;
 		       }
 		       next->next = NULL;
@@ -158,6 +214,9 @@ int mapvbn(struct super_block *sb, struct inode *inode, vms_long vbn,
 		       next->map_inuse = fh2->map_inuse;
 		       memcpy (&next->map[0], &((vms_word*)fh2)[fh2->mpoffset], 
 			       sizeof(vms_word)*fh2->map_inuse);
+		       ods5_mrelease (&mb);
+		       ods5_count(get_sb_info(sb), ODS5_ST_EXT_LOAD, 1);
+		       ods5_iocount(inode, ODS5_IO_EXT_LOAD, 1);
 		       if (down_interruptible(&fh_info->ext_lock)==-EINTR) {
 			       kfree (next);
 			       return 0;
@@ -171,10 +230,45 @@ int mapvbn(struct super_block *sb, struct inode *inode, vms_long vbn,
 		       ext->next = next;
 		       wmb();
 		       up(&fh_info->ext_lock);
+		       ods5_cache_charge(inode, sizeof *next
+					 + sizeof(vms_word) * next->map_inuse);
 	       }
 	    }
 }
 
+static int __mapvbn(struct super_block *sb, struct inode *inode, vms_long vbn,
+		    vms_long * lbn, vms_long * extent, int nowait)
+{
+	struct ods5_sb_info *sb_info;
+	struct ods5_fh_info *fh_info;
+	int walked, ptrs, ret;
+
+	walked = ptrs = 0;
+	ret = map_walk(sb, inode, vbn, lbn, extent, nowait, &walked, &ptrs);
+	sb_info = get_sb_info(sb);
+	ods5_count(sb_info, ODS5_ST_MAPVBN, 1);
+	ods5_iocount(inode, ODS5_IO_MAPVBN, 1);
+	ods5_count(sb_info, ODS5_ST_MAP_PTRS, ptrs);
+	fh_info = inode->i_private;
+	if (walked)
+		atomic_add(walked, &fh_info->walked);
+	trace_ods5_mapvbn(inode, vbn, ret == 1 ? *lbn : 0, ret == 1 ? *extent : 0,
+			  walked, ret);
+	return ret;
+}
+
+int mapvbn(struct super_block *sb, struct inode *inode, vms_long vbn,
+	   vms_long * lbn, vms_long * extent)
+{
+	return __mapvbn(sb, inode, vbn, lbn, extent, 0);
+}
+
+int mapvbn_nowait(struct super_block *sb, struct inode *inode, vms_long vbn,
+		  vms_long * lbn, vms_long * extent)
+{
+	return __mapvbn(sb, inode, vbn, lbn, extent, 1);
+}
+
 /*
  * Check if the passed structure is a valid used ODS5 file header
  */
@@ -32,6 +32,7 @@
 
 #include "./ods5_fs.h"
 #include "./ods5.h"
+#include "./ods5_trace.h"
 
 #ifdef CONFIG_LBDAF
 # define FMT_blkcnt_t "%llu"
@@ -451,9 +452,20 @@ static struct ods5_fid *find_syml_match(char block[ODS5_BLOCK_SIZE],
 	return NULL;
 }
 
+/* the end of a directory scan: trace, count and maybe log it */
+static void lookup_done(struct inode *dir, struct dentry *dentry,
+			vms_long blocks, int found, struct ods5_slow_op *so)
+{
+	trace_ods5_lookup(dir, &dentry->d_name, blocks, found);
+	ods5_count_lookup(get_sb_info(dir->i_sb), blocks, found);
+	ods5_slow_end(dir->i_sb, dir, so, ODS5_SLOW_LOOKUP, dir->i_ino,
+		      dentry->d_name.name, dentry->d_name.len, blocks);
+}
+
 /* same as ods5_lookup but calls find_syml_match (a match without version) */
 static struct dentry *symlink_lookup(struct inode *dir, struct dentry *dentry)
 {
+	struct ods5_slow_op so;
 	vms_long vbn;
 	vms_long lbn, unused;
 	char *block;
@@ -471,12 +483,14 @@ static struct dentry *symlink_lookup(struct inode *dir, struct dentry *dentry)
 
 	vbn = 0;
 	sb_info = get_sb_info(dir->i_sb);
+	ods5_slow_start(dir->i_sb, dir, &so);
 	while (1) {
 		/* map the vbn */
 		vbn += 1;
 		ods5_debug(3, "directory, vbn: %d, blocks: " FMT_blkcnt_t ", size: %lld\n", vbn,
 			   dir->i_blocks, dir->i_size);
 		if ((vbn * ODS5_BLOCK_SIZE) > dir->i_size) {
+			lookup_done(dir, dentry, vbn - 1, 0, &so);
 			d_add(dentry, NULL);
 			return NULL;
 		}
@@ -485,35 +499,35 @@ static struct dentry *symlink_lookup(struct inode *dir, struct dentry *dentry)
 
 		/* read the block */
 		{
-			struct buffer_head *bh;
+			struct ods5_mblk mb;
 			struct ods5_fid *fid;
-			vms_long iopos;
 
-			bh = ods5_bread(dir->i_sb, lbn, &iopos);
-			if (bh == NULL) {
-				ods5_debug(1, "ods5_bread of lbn %d failed\n", lbn);
+			block = ods5_mread(dir->i_sb, lbn, &mb);
+			if (block == NULL) {
+				ods5_debug(1, "ods5_mread of lbn %d failed\n", lbn);
 				return ERR_PTR(-EIO);
 			}
-			block = bh->b_data + iopos;
 
-			/* fid points into the block, it is valid as long as bh is valid */
+			/* fid points into the block, it is valid until the block is released */
 			fid = find_syml_match(block, dentry->d_name.name, fl, sb_info->utf8);
 			if (fid == (struct ods5_fid *)-1) {
+				lookup_done(dir, dentry, vbn, 0, &so);
 				d_add(dentry, NULL);
-				brelse(bh);
+				ods5_mrelease(&mb);
 				return NULL;
 			}
 			if (fid) {
 				struct inode *inode;
+				lookup_done(dir, dentry, vbn, 1, &so);
 				ino = fid->num + (fid->nmx << 16);
 				inode = ods5_iget (dir->i_sb, ino, fid->seq);
-				brelse(bh);
+				ods5_mrelease(&mb);
 				if (!inode)
 					return ERR_PTR(-ENOENT);
 				d_add(dentry, inode);
 				return NULL;
 			}
-			brelse(bh);
+			ods5_mrelease(&mb);
 		}
 	}
 	d_add(dentry, NULL);
@@ -532,6 +546,7 @@ static struct dentry *ods5_lookup(struct inode *dir, struct dentry *dentry,
 	unsigned long ino;
 	struct ods5_sb_info *sb_info;
 	const unsigned char *delim;
+	struct ods5_slow_op so;
 
 	ods5_debug(3, "dir->i_ino: %ld\n", dir->i_ino);
 	ods5_debug(3, "dentry->d_name.len: %d\n", dentry->d_name.len);
@@ -576,12 +591,14 @@ static struct dentry *ods5_lookup(struct inode *dir, struct dentry *dentry,
 	}
 
 	vbn = 0;
+	ods5_slow_start(dir->i_sb, dir, &so);
 	while (1) {
 		/* map the vbn */
 		vbn += 1;
 		ods5_debug(3, "directory, vbn: %d, blocks: " FMT_blkcnt_t ", size: %lld\n", vbn,
 			   dir->i_blocks, dir->i_size);
 		if ((vbn * ODS5_BLOCK_SIZE) > dir->i_size) {
+			lookup_done(dir, dentry, vbn - 1, 0, &so);
 			d_add(dentry, NULL);
 			return NULL;
 		}
@@ -590,37 +607,37 @@ static struct dentry *ods5_lookup(struct inode *dir, struct dentry *dentry,
 
 		/* read the block */
 		{
-			struct buffer_head *bh;
+			struct ods5_mblk mb;
 			struct ods5_fid *fid;
-			vms_long iopos;
 
-			bh = ods5_bread(dir->i_sb, lbn, &iopos);
-			if (bh == NULL) {
-				ods5_debug(1, "ods5_bread of lbn %d failed\n", lbn);
+			block = ods5_mread(dir->i_sb, lbn, &mb);
+			if (block == NULL) {
+				ods5_debug(1, "ods5_mread of lbn %d failed\n", lbn);
 				return ERR_PTR(-EIO);
 			}
-			block = bh->b_data + iopos;
 
-			/* fid points into the block, it is valid as long as bh is valid */
+			/* fid points into the block, it is valid until the block is released */
 			fid = ods5_find_match(block, dentry->d_name.name, fl,
 					      version, sb_info->utf8);
 
 			if (fid == (struct ods5_fid *)-1) {
+				lookup_done(dir, dentry, vbn, 0, &so);
 				d_add(dentry, NULL);
-				brelse(bh);
+				ods5_mrelease(&mb);
 				return NULL;
 			}
 			if (fid) {
 				struct inode *inode;
+				lookup_done(dir, dentry, vbn, 1, &so);
 				ino = fid->num + (fid->nmx << 16);
 				inode = ods5_iget (dir->i_sb, ino, fid->seq);
-				brelse(bh);
+				ods5_mrelease(&mb);
 				if (!inode)
 					return ERR_PTR(-ENOENT);
 				d_add(dentry, inode);
 				return NULL;
 			}
-			brelse(bh);
+			ods5_mrelease(&mb);
 
 		}
 	}
@@ -846,9 +863,30 @@ const char * ods5_get_link (struct dentry *d, struct inode *inode, struct delaye
 	return symlink;
 }
 
+/* the size of a translated file is known after the scan of its records */
+static int ods5_getattr(struct user_namespace *mnt_userns,
+			const struct path *path, struct kstat *stat,
+			u32 request_mask, unsigned int query_flags)
+{
+	struct inode *inode;
+	struct ods5_rms *rms;
+
+	inode = d_inode(path->dentry);
+	if ((request_mask & STATX_SIZE) && ods5_rms_translated(inode)) {
+		rms = ods5_rms_index(inode);
+		if (IS_ERR(rms))
+			return PTR_ERR(rms);
+	}
+	generic_fillattr(mnt_userns, inode, stat);
+	return 0;
+}
+
 struct inode_operations ods5_inode_operations = {
 	.lookup = ods5_lookup,
 };
+struct inode_operations ods5_file_inode_operations = {
+	.getattr = ods5_getattr,
+};
 struct inode_operations ods5_inode_symlink_ops = {
 	.readlink = ods5_readlink,
 	.get_link = ods5_get_link,
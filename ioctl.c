@@ -18,7 +18,10 @@
  * this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <linux/capability.h>
 #include <linux/fs.h>
+#include <linux/sched/signal.h>
+#include <linux/slab.h>
 #include <linux/uaccess.h>
 #include <linux/xattr.h>
 
@@ -42,9 +45,10 @@ static int ods5_xattr_user_get (const struct xattr_handler *handler,
 				struct dentry *dentry, struct inode *inode,
 				const char *name, void *buffer, size_t size) {
 	struct ods5_fh2 *fh2;
-	struct buffer_head *bh;
+	struct ods5_mblk mb;
 	struct ods5_fid fid;
 	struct ods5_fh_info *fh_info;
+	struct ods5_iostat st;
 	size_t minl;
 
 	ods5_debug(2, "name: %s\n", name);
@@ -63,29 +67,205 @@ static int ods5_xattr_user_get (const struct xattr_handler *handler,
 			return minl;
 		if (size<minl)
 			return -ERANGE;
-		bh = ods5_read_fh(inode->i_sb, inode->i_ino, &fh2);
-		if (bh == NULL) {
+		fh2 = ods5_read_fh(inode->i_sb, inode->i_ino, &mb);
+		if (fh2 == NULL) {
 			ods5_debug(1, "ods5_read_fh for ino %lu failed\n", inode->i_ino);
 			return -EIO;
 		}
 		/* its a file header, verify it */
 		fid = mkfid(inode);
 		if (!is_used_fh2(fh2, fid)) {
-			brelse(bh);
+			ods5_mrelease(&mb);
 			return -EBADF;
 		}
 		memcpy(buffer, fh2, minl);
-		brelse(bh);
+		ods5_mrelease(&mb);
+	} else if (strcmp(name, "ods5.iostat")==0) {
+		minl = sizeof st;
+		if (size==0)
+			return minl;
+		if (size<minl)
+			return -ERANGE;
+		ods5_iostat_get(inode, &st);
+		memcpy(buffer, &st, minl);
 	} else
 		return -EOPNOTSUPP;
 	return minl;
 }
 
+/* INDEXF.SYS is read ahead in chunks of that many blocks */
+#define BULKSTAT_CHUNK 128
+
+/* fill a bulkstat record from a valid file header */
+static void fill_bstat(struct ods5_bstat *bs, struct ods5_fh2 *fh2)
+{
+	struct ods5_fi2 *fi2;
+	struct ods5_fi5 *fi5;
+	vms_long efblk;
+
+	memset(bs, 0, sizeof *bs);
+	efblk = (fh2->recattr.efblk.high << 16) + fh2->recattr.efblk.low;
+	if (efblk)
+		bs->size = ((vms_quad)efblk - 1) * ODS5_BLOCK_SIZE
+			+ fh2->recattr.ffbyte;
+	bs->blocks = (fh2->recattr.hiblk.high << 16) + fh2->recattr.hiblk.low;
+	bs->filechar = fh2->filechar;
+	bs->extents = ods5_map_extents((union ods5_fm2 *)&((vms_word *)fh2)[fh2->mpoffset],
+				       fh2->map_inuse, NULL, NULL);
+	bs->fileowner = fh2->fileowner;
+	bs->fid = fh2->fid;
+	bs->backlink = fh2->backlink;
+	bs->ext_fid = fh2->ext_fid;
+	bs->fileprot = fh2->fileprot;
+	bs->linkcount = fh2->linkcount;
+	bs->struclev = fh2->struclev;
+	if (fh2->idoffset == 0)
+		return;
+	if ((fh2->struclev >> 8) == 2) {
+		fi2 = (struct ods5_fi2 *)&((vms_word *) fh2)[fh2->idoffset];
+		bs->credate = fi2->credate;
+		bs->revdate = fi2->revdate;
+	} else {
+		fi5 = (struct ods5_fi5 *)&((vms_word *) fh2)[fh2->idoffset];
+		bs->credate = fi5->credate;
+		bs->revdate = fi5->revdate;
+		bs->accdate = fi5->accdate;
+		bs->attdate = fi5->attdate;
+	}
+}
+
+/*
+ * Return the used file headers in INDEXF.SYS order. Instead of a directory
+ * walk with random header reads, this is one sequential pass over the index
+ * file: the index file bitmap, one block per 4096 file numbers, tells which
+ * headers are in use, the others are skipped; INDEXF.SYS is read ahead in
+ * chunks. Extension headers are skipped, they are not files.
+ */
+static long ods5_ioc_bulkstat(struct file *filp, unsigned long arg)
+{
+	struct super_block *sb;
+	struct ods5_sb_info *sb_info;
+	struct ods5_bulkstat req;
+	struct ods5_bstat bs;
+	struct ods5_bstat __user *ubuf;
+	struct inode *indexf_inode;
+	struct ods5_mblk mb;
+	struct ods5_fh2 *fh2;
+	struct ods5_fid fid;
+	vms_byte *bitmap;
+	vms_long fnum, bmvbn, vbn, ravbn;
+	vms_long lbn, extent;
+	vms_long out, idx;
+	long ret;
+
+	sb = filp->f_path.dentry->d_sb;
+	sb_info = get_sb_info(sb);
+	if (filp->f_path.dentry != sb->s_root)
+		return -EINVAL;
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+	if (copy_from_user(&req, (void __user *)arg, sizeof req))
+		return -EFAULT;
+	ubuf = (struct ods5_bstat __user *)(unsigned long)req.buffer;
+	ods5_debug(2, "cursor: %d, count: %d\n", req.cursor, req.count);
+
+	bitmap = kmalloc(ODS5_BLOCK_SIZE, GFP_KERNEL);
+	if (!bitmap)
+		return -ENOMEM;
+	indexf_inode = ods5_iget(sb, ODS5_INDEXF_INO, ODS5_INDEXF_INO);
+	if (!indexf_inode) {
+		kfree(bitmap);
+		return -EIO;
+	}
+
+	ret = 0;
+	out = 0;
+	bmvbn = 0;
+	ravbn = 0;
+	fnum = req.cursor ? req.cursor : 1;
+	for (; out < req.count && fnum <= sb_info->maxfiles; fnum++) {
+		idx = fnum - 1;
+		/* get the index file bitmap block for this file number */
+		vbn = sb_info->clustersize * 4 + 1 + idx / (ODS5_BLOCK_SIZE * 8);
+		if (vbn != bmvbn) {
+			char *block;
+			if (fatal_signal_pending(current)) {
+				ret = -EINTR;
+				break;
+			}
+			cond_resched();
+			if (!mapvbn(sb, indexf_inode, vbn, &lbn, &extent)) {
+				ret = -EIO;
+				break;
+			}
+			block = ods5_mread(sb, lbn, &mb);
+			if (block == NULL) {
+				ret = -EIO;
+				break;
+			}
+			memcpy(bitmap, block, ODS5_BLOCK_SIZE);
+			ods5_mrelease(&mb);
+			bmvbn = vbn;
+		}
+		idx %= ODS5_BLOCK_SIZE * 8;
+		/* skip unused file numbers, a byte at a time if possible */
+		if (bitmap[idx >> 3] == 0 && (idx & 7) == 0) {
+			fnum += 7;
+			continue;
+		}
+		if ((bitmap[idx >> 3] & (1 << (idx & 7))) == 0)
+			continue;
+
+		/* map and read the file header, read ahead the index file */
+		vbn = sb_info->clustersize * 4 + sb_info->ibmapsize + fnum;
+		if (!mapvbn(sb, indexf_inode, vbn, &lbn, &extent)) {
+			ret = -EIO;
+			break;
+		}
+		if (vbn >= ravbn) {
+			if (extent > BULKSTAT_CHUNK)
+				extent = BULKSTAT_CHUNK;
+			ods5_mreadahead(sb, lbn, extent);
+			ravbn = vbn + extent;
+		}
+		fh2 = (struct ods5_fh2 *)ods5_mread(sb, lbn, &mb);
+		if (fh2 == NULL) {
+			ret = -EIO;
+			break;
+		}
+		fid.num = (vms_word)fnum;
+		fid.seq = fh2->fid.seq;
+		fid.rvn = 0;
+		fid.nmx = (vms_byte)(fnum >> 16);
+		if (!is_used_fh2(fh2, fid) || fh2->seg_num != 0) {
+			ods5_mrelease(&mb);
+			continue;
+		}
+		fill_bstat(&bs, fh2);
+		ods5_mrelease(&mb);
+		if (copy_to_user(&ubuf[out], &bs, sizeof bs)) {
+			ret = -EFAULT;
+			break;
+		}
+		out++;
+	}
+	iput(indexf_inode);
+	kfree(bitmap);
+	/* return what there is, the error shows with the next call */
+	if (ret && out == 0)
+		return ret;
+	req.cursor = fnum;
+	req.count = out;
+	if (copy_to_user((void __user *)arg, &req, sizeof req))
+		return -EFAULT;
+	return 0;
+}
+
 long ods5_ioctl (struct file * filp, unsigned int cmd, unsigned long arg)
 {
 	struct inode *inode;
 	struct ods5_fh2 *fh2;
-	struct buffer_head *bh;
+	struct ods5_mblk mb;
 	struct ods5_fid fid;
 	vms_long not_copied;
 	struct ods5_fh_info *fh_info;
@@ -105,24 +285,46 @@ long ods5_ioctl (struct file * filp, unsigned int cmd, unsigned long arg)
 		}
 		break;		    
 	    case ODS5_IOC_GETFH:
-		    bh = ods5_read_fh(inode->i_sb, inode->i_ino, &fh2);
-		    if (bh == NULL) {
+		    fh2 = ods5_read_fh(inode->i_sb, inode->i_ino, &mb);
+		    if (fh2 == NULL) {
 			ods5_debug(1, "ods5_read_fh for ino %lu failed\n", inode->i_ino);
 			return -EIO;
 		}
 		/* its a file header, verify it */
 		fid = mkfid(inode);
 		if (!is_used_fh2(fh2, fid))
-			return brelse(bh), -EBADF;
+			return ods5_mrelease(&mb), -EBADF;
 		/* copy fh */
 		not_copied = copy_to_user((void*)arg, fh2, sizeof *fh2);
-		brelse(bh);
+		ods5_mrelease(&mb);
 		if (not_copied != 0) {
 			ods5_debug(3, "user addr %p, iobytes: " FMT_size_t ", not copied: %d\n",
 				   (void*)arg, sizeof *fh2, not_copied);
 			return -EFAULT;
 		}
 		break;
+	    case ODS5_IOC_BULKSTAT:
+		return ods5_ioc_bulkstat(filp, arg);
+	    case ODS5_IOC_FIDPATH:
+		return ods5_ioc_fidpath(filp, arg);
+	    case ODS5_IOC_SEARCH:
+		return ods5_ioc_search(filp, arg);
+	    case ODS5_IOC_VERSIONS:
+		return ods5_ioc_versions(filp, arg);
+	    case ODS5_IOC_FILESPEC:
+		return ods5_ioc_filespec(filp, arg);
+	    case ODS5_IOC_PLAN:
+		return ods5_ioc_plan(filp, arg);
+	    case ODS5_IOC_PREFETCH:
+		return ods5_ioc_prefetch(filp, arg);
+	    case ODS5_IOC_PREFETCH_STATUS:
+		return ods5_ioc_prefetch_status(filp, arg);
+	    case ODS5_IOC_RECORDS:
+		return ods5_ioc_records(filp, arg);
+	    case ODS5_IOC_KEYED:
+		return ods5_ioc_keyed(filp, arg);
+	    case ODS5_IOC_PROFILE:
+		return ods5_ioc_profile(filp, arg);
 	    default:
 		return -ENOTTY;
 	}
@@ -0,0 +1,195 @@
+/*
+ * linux/fs/ods5/iostat.c
+ *
+ * This file is part of the OpenVMS ODS5 file system for Linux.
+ * Copyright (C) 2017 Hartmut Becker.
+ *
+ * The OpenVMS ODS5 file system for Linux is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The OpenVMS ODS5 file system for Linux is distributed in the hope that it
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/fs.h>
+#include <linux/list.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/sysfs.h>
+
+#include "./ods5_fs.h"
+#include "./ods5.h"
+
+/*
+ * Per file I/O accounting.
+ * When a file is opened its inode gets per CPU counters, so the read path
+ * only does a this_cpu_add: the bytes read, the I/O blocks read from disk,
+ * on demand or read ahead, the reads served by the buffer cache, the mapvbn
+ * calls and the extension headers loaded. The counters live as long as the
+ * inode. They are returned in the user.ods5.iostat xattr, and the files with
+ * the most blocks from disk are shown in /sys/fs/ods5/<device>/top_files.
+ * For that, the inodes with counters are on a list of the sb_info.
+ */
+
+void ods5_iostat_init(struct ods5_sb_info *sb_info)
+{
+	INIT_LIST_HEAD(&sb_info->io_files);
+	spin_lock_init(&sb_info->io_lock);
+}
+
+/* give the inode its counters, without them the file is not accounted */
+void ods5_iostat_open(struct inode *inode)
+{
+	struct ods5_sb_info *sb_info;
+	struct ods5_fh_info *fh_info;
+	struct ods5_iofile *io;
+
+	fh_info = inode->i_private;
+	if (READ_ONCE(fh_info->io))
+		return;
+	io = kmalloc(sizeof *io, GFP_NOFS);
+	if (io == NULL)
+		return;
+	io->c = alloc_percpu_gfp(struct ods5_iocounts, GFP_NOFS);
+	if (io->c == NULL) {
+		kfree(io);
+		return;
+	}
+	io->ino = inode->i_ino;
+	sb_info = get_sb_info(inode->i_sb);
+	spin_lock(&sb_info->io_lock);
+	if (fh_info->io == NULL) {
+		list_add_tail(&io->list, &sb_info->io_files);
+		/* the zeroed counters are visible before the pointer */
+		smp_store_release(&fh_info->io, io);
+		io = NULL;
+	}
+	spin_unlock(&sb_info->io_lock);
+	if (io) {
+		free_percpu(io->c);
+		kfree(io);
+	}
+}
+
+void ods5_iostat_evict(struct inode *inode)
+{
+	struct ods5_sb_info *sb_info;
+	struct ods5_fh_info *fh_info;
+	struct ods5_iofile *io;
+
+	fh_info = inode->i_private;
+	io = fh_info->io;
+	if (io == NULL)
+		return;
+	sb_info = get_sb_info(inode->i_sb);
+	spin_lock(&sb_info->io_lock);
+	list_del(&io->list);
+	spin_unlock(&sb_info->io_lock);
+	free_percpu(io->c);
+	kfree(io);
+}
+
+static void iostat_sum(struct ods5_iofile *io, struct ods5_iostat *st)
+{
+	struct ods5_iocounts *c;
+	u64 sum[ODS5_IO_COUNT];
+	int cpu, i;
+
+	memset(sum, 0, sizeof sum);
+	for_each_possible_cpu(cpu) {
+		c = per_cpu_ptr(io->c, cpu);
+		for (i = 0; i < ODS5_IO_COUNT; i++)
+			sum[i] += c->c[i];
+	}
+	st->bytes = sum[ODS5_IO_BYTES];
+	st->disk = sum[ODS5_IO_DISK];
+	st->cached = sum[ODS5_IO_CACHED];
+	st->mapvbn = sum[ODS5_IO_MAPVBN];
+	st->ext_loads = sum[ODS5_IO_EXT_LOAD];
+}
+
+/* the counters of an inode, all zero if the file was never opened */
+void ods5_iostat_get(struct inode *inode, struct ods5_iostat *st)
+{
+	struct ods5_fh_info *fh_info;
+	struct ods5_iofile *io;
+
+	memset(st, 0, sizeof *st);
+	fh_info = inode->i_private;
+	io = READ_ONCE(fh_info->io);
+	if (io)
+		iostat_sum(io, st);
+}
+
+/* files summed per lock hold, see ods5_iostat_top */
+#define ODS5_IOSTAT_BATCH	64
+
+/*
+ * The ODS5_IOSTAT_TOP files with the most blocks from disk, one per line.
+ * The counters are summed with the lock held, evict can't free them. The
+ * list is walked in batches, between them the lock is dropped and a marker,
+ * an ods5_iofile without counters, keeps the place.
+ */
+ssize_t ods5_iostat_top(struct ods5_sb_info *sb_info, char *buf)
+{
+	struct top {
+		unsigned long ino;
+		struct ods5_iostat st;
+	} *top, t;
+	struct ods5_iofile *io, mark;
+	int i, n, batch;
+	ssize_t len;
+
+	top = kmalloc_array(ODS5_IOSTAT_TOP, sizeof *top, GFP_KERNEL);
+	if (top == NULL)
+		return -ENOMEM;
+	n = 0;
+	batch = 0;
+	mark.c = NULL;
+	spin_lock(&sb_info->io_lock);
+	list_add(&mark.list, &sb_info->io_files);
+	while (mark.list.next != &sb_info->io_files) {
+		if (++batch == ODS5_IOSTAT_BATCH) {
+			spin_unlock(&sb_info->io_lock);
+			cond_resched();
+			spin_lock(&sb_info->io_lock);
+			batch = 0;
+			continue;
+		}
+		io = list_next_entry(&mark, list);
+		list_move(&mark.list, &io->list);
+		/* the marker of a concurrent reader */
+		if (io->c == NULL)
+			continue;
+		iostat_sum(io, &t.st);
+		if (t.st.disk == 0)
+			continue;
+		if (n == ODS5_IOSTAT_TOP && t.st.disk <= top[n - 1].st.disk)
+			continue;
+		t.ino = io->ino;
+		/* insertion, keep it sorted, largest first */
+		i = n < ODS5_IOSTAT_TOP ? n++ : n - 1;
+		for (; i > 0 && top[i - 1].st.disk < t.st.disk; i--)
+			top[i] = top[i - 1];
+		top[i] = t;
+	}
+	list_del(&mark.list);
+	spin_unlock(&sb_info->io_lock);
+
+	len = sysfs_emit(buf, "# ino disk cached bytes mapvbn ext_loads\n");
+	for (i = 0; i < n; i++)
+		len += sysfs_emit_at(buf, len, "%lu %llu %llu %llu %llu %llu\n",
+				     top[i].ino, top[i].st.disk,
+				     top[i].st.cached, top[i].st.bytes,
+				     top[i].st.mapvbn, top[i].st.ext_loads);
+	kfree(top);
+	return len;
+}
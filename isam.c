@@ -0,0 +1,504 @@
+/*
+ * linux/fs/ods5/isam.c
+ *
+ * This file is part of the OpenVMS ODS5 file system for Linux.
+ * Copyright (C) 2017 Hartmut Becker.
+ *
+ * The OpenVMS ODS5 file system for Linux is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The OpenVMS ODS5 file system for Linux is distributed in the hope that it
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/sched/signal.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <asm/unaligned.h>
+
+#include "./ods5_fs.h"
+#include "./ods5.h"
+
+/*
+ * Keyed access to RMS indexed files, ODS5_IOC_KEYED.
+ * The descriptor of the primary key is at the start of the prologue, in
+ * vbn 1. From its root bucket the index buckets are searched down to the
+ * data level: the key of an index record is the highest key in the bucket
+ * it points to, so the first index key not less than the search key leads
+ * to the first candidate. The data buckets are chained in key order, they
+ * are read forward from there, while the records are in the key range.
+ * The next data bucket is read ahead when a bucket is decoded.
+ * Only the formats without compression are decoded: prologue 1 and 2 and
+ * prologue 3 without key, index and record compression, string keys.
+ * Everything else is EOPNOTSUPP.
+ */
+
+/* the prologue, vbn 1 */
+#define PLG_VER_NO	116
+/* the key descriptor of the primary key, at the start of the prologue */
+#define KEY_ROOTLEV	9
+#define KEY_IDXBKTSZ	10
+#define KEY_DATBKTSZ	11
+#define KEY_ROOTVBN	12
+#define KEY_FLAGS	16
+#define KEY_DATATYPE	17
+#define KEY_SEGMENTS	18
+#define KEY_KEYSZ	20
+#define KEY_POS		28
+#define KEY_SIZ		44
+#define KEY_TYPE	88
+#define KEY_IDX_COMPR	0x08
+#define KEY_KEY_COMPR	0x40
+#define KEY_REC_COMPR	0x80
+#define KEY_STRING	0
+#define KEY_MAXSEG	8
+#define KEY_MAXSZ	255	/* the key buffers of ods5_ioc_keyed */
+/* the bucket header */
+#define BKT_CHECKCHAR	0
+#define BKT_FREESPACE	4
+#define BKT_NXTBKT	8
+#define BKT_LEVEL	12
+#define BKT_BKTCB	13
+#define BKT_OVERHEAD	14
+#define BKT_LASTBKT	0x01
+/* prologue 3: the end of an index bucket, check byte and vbn free space */
+#define BKT_ENDOVHD	4
+/* the record control byte */
+#define IRC_PTRSZ	0x03
+#define IRC_DELETED	0x04
+#define IRC_RRV		0x08
+
+typedef struct isam {
+	struct super_block *sb;
+	struct inode *inode;
+	struct ods5_fat *fat;
+	int prolog;
+	vms_long rootvbn;
+	vms_byte rootlev;
+	vms_long idxbkt;	/* bucket sizes in bytes */
+	vms_long datbkt;
+	vms_byte keysz;
+	vms_byte segments;
+	vms_word pos[KEY_MAXSEG];
+	vms_byte siz[KEY_MAXSEG];
+	char *bkt;		/* the current bucket */
+	vms_long vbn;
+} _ISAM;
+
+/* read the bucket with size bytes at vbn into ix->bkt */
+static int read_bucket(struct isam *ix, vms_long vbn, vms_long size)
+{
+	struct ods5_mblk mb;
+	vms_long lbn, extent, nblk, i;
+	char *p;
+
+	nblk = size / ODS5_BLOCK_SIZE;
+	for (i = 0; i < nblk; i++) {
+		if (!mapvbn(ix->sb, ix->inode, vbn + i, &lbn, &extent))
+			return -EIO;
+		/* a bucket is read as a whole */
+		if (i == 0 && extent > 1)
+			ods5_mreadahead(ix->sb, lbn, min(extent, nblk));
+		p = ods5_mread(ix->sb, lbn, &mb);
+		if (p == NULL)
+			return -EIO;
+		memcpy(ix->bkt + i * ODS5_BLOCK_SIZE, p, ODS5_BLOCK_SIZE);
+		ods5_mrelease(&mb);
+	}
+	if (ix->bkt[BKT_CHECKCHAR] != ix->bkt[size - 1]) {
+		ods5_debug(1, "bucket at vbn %d, check byte mismatch\n", vbn);
+		return -EIO;
+	}
+	ix->vbn = vbn;
+	return 0;
+}
+
+/* start reading the bucket at vbn, for the scan to come */
+static void readahead_bucket(struct isam *ix, vms_long vbn, vms_long size)
+{
+	vms_long lbn, extent, i;
+
+	for (i = 0; i < size / ODS5_BLOCK_SIZE; i += extent) {
+		if (!mapvbn_nowait(ix->sb, ix->inode, vbn + i, &lbn, &extent))
+			return;
+		if (extent > size / ODS5_BLOCK_SIZE - i)
+			extent = size / ODS5_BLOCK_SIZE - i;
+		ods5_mreadahead(ix->sb, lbn, extent);
+	}
+}
+
+/* the primary key descriptor */
+static int isam_init(struct isam *ix, struct inode *inode)
+{
+	struct ods5_fh_info *fh_info;
+	struct ods5_mblk mb;
+	vms_long lbn, extent;
+	vms_byte flags;
+	vms_long sum;
+	char *plg;
+	int i, ret;
+
+	fh_info = inode->i_private;
+	ix->sb = inode->i_sb;
+	ix->inode = inode;
+	ix->fat = &fh_info->recattr;
+	ix->bkt = NULL;
+	ix->vbn = 0;
+	if (ix->fat->rtype.fileorg != FAT_INDEXED)
+		return -EINVAL;
+	if (!mapvbn(ix->sb, inode, 1, &lbn, &extent))
+		return -EIO;
+	plg = ods5_mread(ix->sb, lbn, &mb);
+	if (plg == NULL)
+		return -EIO;
+	ret = -EOPNOTSUPP;
+	ix->prolog = get_unaligned_le16(plg + PLG_VER_NO);
+	if (ix->prolog < 1 || ix->prolog > 3)
+		goto out;
+	flags = plg[KEY_FLAGS];
+	if (ix->prolog == 3
+	    && (flags & (KEY_IDX_COMPR | KEY_KEY_COMPR | KEY_REC_COMPR)))
+		goto out;
+	if ((vms_byte)plg[KEY_DATATYPE] != KEY_STRING)
+		goto out;
+	ix->rootlev = plg[KEY_ROOTLEV];
+	ix->rootvbn = get_unaligned_le32(plg + KEY_ROOTVBN);
+	ix->idxbkt = (vms_byte)plg[KEY_IDXBKTSZ];
+	ix->datbkt = (vms_byte)plg[KEY_DATBKTSZ];
+	if (ix->idxbkt == 0)
+		ix->idxbkt = ix->fat->bktsize;
+	if (ix->datbkt == 0)
+		ix->datbkt = ix->fat->bktsize;
+	ix->idxbkt *= ODS5_BLOCK_SIZE;
+	ix->datbkt *= ODS5_BLOCK_SIZE;
+	ix->keysz = plg[KEY_KEYSZ];
+	ix->segments = plg[KEY_SEGMENTS];
+	ret = -EIO;
+	if (ix->segments == 0 || ix->segments > KEY_MAXSEG || ix->keysz == 0
+	    || ix->idxbkt == 0 || ix->datbkt == 0 || ix->rootvbn == 0)
+		goto out;
+	for (i = sum = 0; i < ix->segments; i++) {
+		ix->pos[i] = get_unaligned_le16(plg + KEY_POS + 2 * i);
+		ix->siz[i] = plg[KEY_SIZ + i];
+		sum += ix->siz[i];
+		if (ix->prolog == 3 && (vms_byte)plg[KEY_TYPE + i] != KEY_STRING) {
+			ret = -EOPNOTSUPP;
+			goto out;
+		}
+	}
+	/* record_key builds the key from the segments into KEY_MAXSZ bytes */
+	if (sum != ix->keysz || ix->keysz > KEY_MAXSZ) {
+		ods5_debug(1, "key size %d, segments %d bytes\n", ix->keysz, sum);
+		ret = -EINVAL;
+		goto out;
+	}
+	ods5_debug(2, "prologue %d, root vbn %d, level %d, key size %d, buckets %d/%d\n",
+		   ix->prolog, ix->rootvbn, ix->rootlev, ix->keysz,
+		   ix->idxbkt, ix->datbkt);
+	ret = 0;
+	ix->bkt = kvmalloc(max(ix->idxbkt, ix->datbkt), GFP_KERNEL);
+	if (!ix->bkt)
+		ret = -ENOMEM;
+out:
+	ods5_mrelease(&mb);
+	return ret;
+}
+
+/* compare the first len bytes of a key, a generic key is shorter */
+static int key_cmp(const char *key, const char *k, vms_long len)
+{
+	return memcmp(key, k, len);
+}
+
+/*
+ * The vbn of the bucket one level down, for the first index key not less
+ * than the search key; 0 if all keys are less.
+ */
+static vms_long index_down(struct isam *ix, const char *k, vms_long klen)
+{
+	vms_long free, off, n, i, ptrsz, vbn;
+	vms_byte ctl;
+	char *p;
+
+	free = get_unaligned_le16(ix->bkt + BKT_FREESPACE);
+	if (free < BKT_OVERHEAD || free > ix->idxbkt)
+		return 0;
+	if (ix->prolog == 3) {
+		/* the keys up front, the pointers from the end down */
+		ptrsz = ((ix->bkt[BKT_BKTCB] >> 3) & 3) + 2;
+		n = (free - BKT_OVERHEAD) / ix->keysz;
+		for (i = 0; i < n; i++) {
+			if (key_cmp(ix->bkt + BKT_OVERHEAD + i * ix->keysz, k, klen) >= 0)
+				break;
+		}
+		if (i == n)
+			return 0;
+		p = ix->bkt + ix->idxbkt - BKT_ENDOVHD - (i + 1) * ptrsz;
+		if (p < ix->bkt + free)
+			return 0;
+	} else {
+		/* control byte, pointer, key */
+		for (off = BKT_OVERHEAD; off < free; off += 1 + ptrsz + ix->keysz) {
+			ctl = ix->bkt[off];
+			ptrsz = (ctl & IRC_PTRSZ) + 2;
+			if (off + 1 + ptrsz + ix->keysz > free)
+				return 0;
+			if (key_cmp(ix->bkt + off + 1 + ptrsz, k, klen) >= 0)
+				break;
+		}
+		if (off >= free)
+			return 0;
+		p = ix->bkt + off + 1;
+	}
+	vbn = 0;
+	for (i = 0; i < ptrsz; i++)
+		vbn |= (vms_long)(vms_byte)p[i] << (8 * i);
+	return vbn;
+}
+
+/*
+ * From the root down to the first data bucket which may have the key,
+ * *vbn is 0 if there is none.
+ */
+static int find_data(struct isam *ix, const char *k, vms_long klen,
+		     vms_long *vbn)
+{
+	int level, ret;
+
+	*vbn = ix->rootvbn;
+	for (level = ix->rootlev; level > 0 && *vbn; level--) {
+		ret = read_bucket(ix, *vbn, ix->idxbkt);
+		if (ret)
+			return ret;
+		if ((vms_byte)ix->bkt[BKT_LEVEL] != level) {
+			ods5_debug(1, "bucket at vbn %d, level %d, expected %d\n",
+				   *vbn, (vms_byte)ix->bkt[BKT_LEVEL], level);
+			return -EIO;
+		}
+		*vbn = index_down(ix, k, klen);
+		ods5_debug(3, "level %d, down to vbn %d\n", level, *vbn);
+	}
+	return 0;
+}
+
+/* the key of the record data, from its segments */
+static void record_key(struct isam *ix, const char *data, vms_long len,
+		       char *key)
+{
+	vms_long i, n, o;
+
+	for (i = o = 0; i < ix->segments; o += ix->siz[i++]) {
+		n = ix->siz[i];
+		if (ix->pos[i] >= len)
+			n = 0;
+		else if (ix->pos[i] + n > len)
+			n = len - ix->pos[i];
+		memcpy(key + o, data + ix->pos[i], n);
+		memset(key + o + n, 0, ix->siz[i] - n);
+	}
+}
+
+/* the record header: control, id, and the id and vbn of the RRV */
+static inline vms_long data_hdr(struct isam *ix)
+{
+	return ix->prolog == 3 ? 9 : 7;
+}
+
+/*
+ * The data record at *off of the current bucket: its id, data and length,
+ * *off is advanced. Returns 1 for a record, 0 at the end of the bucket.
+ */
+static int data_next(struct isam *ix, vms_long *off, vms_word *id,
+		     char **data, vms_long *len)
+{
+	vms_long free, hdr;
+	vms_byte ctl;
+	char *p;
+
+	free = get_unaligned_le16(ix->bkt + BKT_FREESPACE);
+	if (free > ix->datbkt - 1)
+		free = ix->datbkt - 1;
+	for (;;) {
+		hdr = data_hdr(ix);
+		/* *off may come from the caller, don't let it wrap */
+		if (*off > free || hdr > free - *off)
+			return 0;
+		p = ix->bkt + *off;
+		ctl = p[0];
+		/* a pointer to a record moved to another bucket */
+		if (ctl & IRC_RRV) {
+			*off += hdr;
+			continue;
+		}
+		if (ix->prolog == 3)
+			*id = get_unaligned_le16(p + 1);
+		else
+			*id = (vms_byte)p[1];
+		if (ix->fat->rtype.rtype == FAT_FIXED)
+			*len = ix->fat->rsize;
+		else {
+			*len = 0;
+			if (*off + hdr + 2 <= free)
+				*len = get_unaligned_le16(p + hdr);
+			hdr += 2;
+		}
+		if (*off + hdr + *len > free) {
+			ods5_debug(1, "bucket at vbn %d, record at %d too long\n",
+				   ix->vbn, *off);
+			return -EIO;
+		}
+		*data = p + hdr;
+		*off += hdr + *len;
+		if (!(ctl & IRC_DELETED))
+			return 1;
+	}
+}
+
+long ods5_ioc_keyed(struct file *filp, unsigned long arg)
+{
+	struct inode *inode;
+	struct ods5_keyed req;
+	struct ods5_recdesc desc;
+	struct ods5_recdesc __user *udesc;
+	struct isam ix;
+	char lo[KEY_MAXSZ], hi[KEY_MAXSZ], key[KEY_MAXSZ];
+	vms_long vbn, off, prev, len, used, n, nxt;
+	vms_word id;
+	char *data;
+	long ret;
+
+	inode = file_inode(filp);
+	if (!S_ISREG(inode->i_mode))
+		return -EINVAL;
+	if (copy_from_user(&req, (void __user *)arg, sizeof req))
+		return -EFAULT;
+	if ((req.flags & ~ODS5_KEYED_RANGE) || req.spare)
+		return -EINVAL;
+	if (!(req.flags & ODS5_KEYED_RANGE)) {
+		req.key2 = req.key;
+		req.key2len = req.keylen;
+	}
+	if (req.count > ODS5_RECORDS_MAX)
+		req.count = ODS5_RECORDS_MAX;
+	ret = isam_init(&ix, inode);
+	if (ret)
+		goto out;
+	ret = -EINVAL;
+	if (req.keylen > ix.keysz || req.key2len > ix.keysz
+	    || (req.keylen == 0 && !(req.flags & ODS5_KEYED_RANGE)))
+		goto out;
+	ret = -EFAULT;
+	if (copy_from_user(lo, (void __user *)(unsigned long)req.key, req.keylen)
+	    || copy_from_user(hi, (void __user *)(unsigned long)req.key2,
+			      req.key2len))
+		goto out;
+
+	/* continue at the cursor or search the index */
+	vbn = req.cursor;
+	off = req.offset;
+	if (vbn == 0) {
+		ret = find_data(&ix, lo, req.keylen, &vbn);
+		if (ret)
+			goto out;
+		off = BKT_OVERHEAD;
+	} else if (off < BKT_OVERHEAD || off >= ix.datbkt - data_hdr(&ix)) {
+		ret = -EINVAL;
+		goto out;
+	}
+	ods5_debug(2, "data bucket at vbn %d, offset %d\n", vbn, off);
+
+	udesc = (struct ods5_recdesc __user *)(unsigned long)req.descs;
+	used = 0;
+	n = 0;
+	ret = 0;
+	while (vbn && n < req.count) {
+		if (vbn != ix.vbn) {
+			ret = read_bucket(&ix, vbn, ix.datbkt);
+			if (ret)
+				break;
+			if (ix.bkt[BKT_LEVEL] != 0) {
+				ret = -EIO;
+				break;
+			}
+			if (!(ix.bkt[BKT_BKTCB] & BKT_LASTBKT))
+				readahead_bucket(&ix, get_unaligned_le32(ix.bkt + BKT_NXTBKT),
+						 ix.datbkt);
+		}
+		nxt = get_unaligned_le32(ix.bkt + BKT_NXTBKT);
+		prev = off;
+		ret = data_next(&ix, &off, &id, &data, &len);
+		if (ret < 0)
+			break;
+		if (ret == 0) {
+			/* on to the next bucket */
+			vbn = 0;
+			if (!(ix.bkt[BKT_BKTCB] & BKT_LASTBKT))
+				vbn = nxt;
+			off = BKT_OVERHEAD;
+			if (fatal_signal_pending(current)) {
+				ret = -EINTR;
+				break;
+			}
+			cond_resched();
+			continue;
+		}
+		ret = 0;
+		record_key(&ix, data, len, key);
+		if (key_cmp(key, lo, req.keylen) < 0)
+			continue;
+		if (req.key2len && key_cmp(key, hi, req.key2len) > 0) {
+			/* past the range, done */
+			vbn = 0;
+			break;
+		}
+		if (len > req.size - used) {
+			/* leave it for the next call */
+			off = prev;
+			if (n == 0) {
+				used = len;
+				ret = -ERANGE;
+			}
+			break;
+		}
+		if (copy_to_user((char __user *)(unsigned long)req.buffer + used,
+				 data, len)) {
+			ret = -EFAULT;
+			break;
+		}
+		/* the RFA: vbn and id */
+		desc.pos = ((vms_quad)vbn << 16) | id;
+		desc.offset = used;
+		desc.length = len;
+		if (copy_to_user(&udesc[n], &desc, sizeof desc)) {
+			ret = -EFAULT;
+			break;
+		}
+		used += len;
+		n++;
+	}
+	/* the records so far are returned, the error comes with the next call */
+	if (n && ret != -EFAULT)
+		ret = 0;
+	if (ret && ret != -ERANGE)
+		goto out;
+
+	req.count = n;
+	req.size = used;
+	req.cursor = vbn;
+	req.offset = vbn ? off : 0;
+	if (copy_to_user((void __user *)arg, &req, sizeof req))
+		ret = -EFAULT;
+out:
+	kvfree(ix.bkt);
+	return ret;
+}
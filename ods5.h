@@ -23,11 +23,28 @@
 #include "./vms_types.h"
 #include "./ods5_fs.h"
 #include <linux/buffer_head.h>
+#include <linux/completion.h>
+#include <linux/hashtable.h>
+#include <linux/highmem.h>
+#include <linux/kobject.h>
+#include <linux/mutex.h>
+#include <linux/pagemap.h>
+#include <linux/percpu.h>
 #include <linux/semaphore.h>
+#include <linux/seq_file.h>
+#include <linux/shrinker.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
 
 #ifdef DEBUG
+/*
+ * The debug calls are in hot loops: with ods5_debug_level 0 the static key
+ * is off and they cost a no-op instead of a load and compare.
+ */
+#include <linux/jump_label.h>
 extern int ods5_debug_level;
-#define ods5_debug(l,fmt,arg...) if (ods5_debug_level>=l) pr_debug ("ODS5(%s), " fmt,__func__,##arg)
+DECLARE_STATIC_KEY_FALSE(ods5_debug_key);
+#define ods5_debug(l,fmt,arg...) if (static_branch_unlikely(&ods5_debug_key) && ods5_debug_level>=l) pr_debug ("ODS5(%s), " fmt,__func__,##arg)
 #else
 #define ods5_debug(fmt,arg...)
 #endif
@@ -40,6 +57,134 @@ extern int ods5_debug_level;
 # define FMT_size_t "%u"
 #endif
 
+/* states of the mount-time warm-up, see warm.c */
+#define ODS5_WARM_OFF		0
+#define ODS5_WARM_QUEUED	1
+#define ODS5_WARM_RUNNING	2
+#define ODS5_WARM_DONE		3
+#define ODS5_WARM_STOPPED	4
+/* default and maximum directory levels for warm=, the walk is recursive */
+#define ODS5_WARM_DEPTH		1
+#define ODS5_WARM_MAXDEPTH	8
+
+/* prefetch, the states are the warm-up states, see prefetch.c */
+#define ODS5_PF_INFLIGHT	2048
+
+/* a checkpoint for every that many records or raw bytes, see rms.c */
+#define ODS5_RMS_CKPT		64
+#define ODS5_STREAM_CKPT	65536
+/* what ods5_rms_translated returns */
+#define ODS5_XLATE_NONE		0
+#define ODS5_XLATE_RECORDS	1
+#define ODS5_XLATE_CR		2
+#define ODS5_XLATE_CRLF		3
+
+/* reverse name cache for FID to path, see fidpath.c */
+#define ODS5_NAME_HASH_BITS	10
+#define ODS5_NAME_CACHE_MAX	16384
+
+/* performance counters, per CPU, summed up for sysfs */
+enum ods5_stat {
+	ODS5_ST_MREAD,		/* metadata reads which went to disk */
+	ODS5_ST_BREAD,		/* data blocks read */
+	ODS5_ST_LOOKUP,
+	ODS5_ST_LOOKUP_NEG,
+	ODS5_ST_LOOKUP_BLOCKS,	/* directory blocks scanned by lookups */
+	ODS5_ST_EXT_LOAD,	/* extension headers loaded */
+	ODS5_ST_MAPVBN,
+	ODS5_ST_MAP_PTRS,	/* retrieval pointers decoded by mapvbn */
+	ODS5_ST_READDIR_BLOCKS,
+	ODS5_ST_READDIR_ENTRIES,
+	ODS5_ST_NAME_HIT,	/* reverse name cache */
+	ODS5_ST_NAME_MISS,
+	ODS5_ST_RMS_HIT,	/* checkpoint index of translated files */
+	ODS5_ST_RMS_BUILD,
+	ODS5_ST_HDR_HIT,	/* decoded file header cache */
+	ODS5_ST_HDR_MISS,
+	ODS5_ST_COUNT
+};
+/* directory blocks per lookup: 1, 2, 3-4, 5-8, ..., 33-64, more */
+#define ODS5_LOOKUP_HIST	8
+
+typedef struct ods5_stats {
+	u64 c[ODS5_ST_COUNT];
+	u64 lookup_hist[ODS5_LOOKUP_HIST];
+} _ODS5_STATS;
+
+/* per file I/O accounting, see iostat.c */
+enum ods5_io {
+	ODS5_IO_BYTES,
+	ODS5_IO_DISK,
+	ODS5_IO_CACHED,
+	ODS5_IO_MAPVBN,
+	ODS5_IO_EXT_LOAD,
+	ODS5_IO_COUNT
+};
+#define ODS5_IOSTAT_TOP		20
+
+typedef struct ods5_iocounts {
+	u64 c[ODS5_IO_COUNT];
+} _ODS5_IOCOUNTS;
+
+typedef struct ods5_iofile {
+	struct list_head list;		/* on io_files of the sb_info */
+	unsigned long ino;
+	struct ods5_iocounts __percpu *c;
+} _ODS5_IOFILE;
+
+/* slow operation log, see slow.c */
+#define ODS5_SLOW_RING		256
+#define ODS5_SLOW_NAME		48
+#define ODS5_SLOW_LOOKUP	0
+#define ODS5_SLOW_READDIR	1
+#define ODS5_SLOW_HEADER	2
+#define ODS5_SLOW_READ		3
+
+/* memory budget of the driver caches, see cache.c */
+#define ODS5_CACHE_KB		16384
+#define ODS5_CACHE_MAXKB	(1024 * 1024)
+enum ods5_cache_type {
+	ODS5_CACHE_NAME,
+	ODS5_CACHE_INODE,	/* extension header maps and record index */
+	ODS5_CACHE_HEADER,	/* decoded file headers */
+	ODS5_CACHE_TYPES
+};
+
+typedef struct ods5_cache_ent {
+	struct list_head lru;	/* on cache_lru of the sb_info, or empty */
+	vms_long bytes;		/* charged */
+	vms_byte type;
+} _ODS5_CACHE_ENT;
+
+/* decoded file header cache, see hdrcache.c */
+#define ODS5_HDR_HASH_BITS	14
+#define ODS5_HDR_MAXMAP		32
+
+/* what ods5_read_inode takes from a file header */
+typedef struct ods5_hdr {
+	loff_t size;
+	vms_quad ctime;		/* VMS times, valid if times is set */
+	vms_quad mtime;
+	vms_quad atime;
+	vms_long blocks;
+	umode_t mode;		/* without the mode option */
+	struct vms_uic fileowner;
+	vms_word nlink;
+	vms_word seq;
+	vms_byte times;
+	vms_byte map_inuse;
+	struct ods5_fat recattr;
+	struct ods5_fid ext_fid;
+	struct ods5_fid backlink;
+	vms_word map[ODS5_HDR_MAXMAP];	/* if map_inuse fits */
+} _ODS5_HDR;
+
+/* an operation being timed */
+typedef struct ods5_slow_op {
+	u64 start;		/* 0 if not timed */
+	int walked;
+} _ODS5_SLOW_OP;
+
 /* super block extension */
 typedef struct ods5_sb_info {
 	vms_long ibmapsize;
@@ -52,6 +197,9 @@ typedef struct ods5_sb_info {
 	vms_long volsize;
 	vms_long home;		/* home lbn, decimal, >0 */
 	vms_long mode;		/* mode has an umask value, octal */
+	vms_long ra_kb;		/* readahead limit in KB, 0 disables it */
+	vms_long cache_kb;	/* cache budget in KB, 0 is no limit */
+	vms_long warm_depth;	/* directory levels to warm up */
 	vms_word blocksize;
 	vms_word clustersize;
 	vms_word volchar;
@@ -60,8 +208,66 @@ typedef struct ods5_sb_info {
 	vms_byte home_opt;
 	vms_byte mode_opt;
 	vms_byte bs_opt;
+	vms_byte ra_opt;
+	vms_byte cache_opt;
+	vms_byte warm_opt;
 	vms_byte syml;
 	vms_byte utf8;
+	vms_byte records;	/* translate variable length records */
+	vms_byte crlf;		/* translate CR and CRLF of stream files */
+	vms_byte prof_opt;	/* record an access profile from the mount */
+	struct super_block *sb;
+	/* sysfs directory /sys/fs/ods5/<device>/ */
+	struct kobject kobj;
+	struct completion kobj_unregister;
+	vms_byte sysfs;
+	/* mount-time warm-up, progress shown in sysfs */
+	struct work_struct warm_work;
+	int warm_state;
+	atomic_t warm_headers;
+	atomic_t warm_dirs;
+	atomic_t warm_blocks;
+	/* batch prefetch, progress shown in sysfs */
+	struct work_struct pf_work;
+	int pf_state;
+	struct ods5_fid *pf_fids;
+	vms_long pf_nfids;
+	atomic_t pf_files;
+	atomic_t pf_blocks;
+	struct ods5_run *pf_runs;	/* a profile to replay */
+	vms_long pf_nruns;
+	/* access profile, see profile.c */
+	int prof_on;
+	struct mutex prof_mutex;
+	spinlock_t prof_lock;
+	struct ods5_run *prof;
+	vms_long prof_count;
+	/* child FID to parent FID and name, for FID to path */
+	DECLARE_HASHTABLE(name_hash, ODS5_NAME_HASH_BITS);
+	struct list_head name_lru;
+	vms_long name_count;
+	/* the cache budget, cache_lock also protects the name cache */
+	spinlock_t cache_lock;
+	struct list_head cache_lru;
+	unsigned long cache_count;
+	unsigned long cache_total;
+	unsigned long cache_bytes[ODS5_CACHE_TYPES];
+	struct shrinker cache_shrinker;
+	/* decoded file headers by file number, under cache_lock */
+	struct hlist_head *hdr_hash;
+	vms_long hdr_count;
+	struct ods5_stats __percpu *stats;
+	/* debugfs directory /sys/kernel/debug/ods5/<device>/ */
+	struct dentry *debugfs;
+	/* slow operation log */
+	u64 slow_ns;		/* threshold, 0 is off */
+	struct ods5_slow *slow;
+	spinlock_t slow_lock;
+	vms_long slow_head;
+	vms_long slow_count;
+	/* files with I/O accounting */
+	struct list_head io_files;
+	spinlock_t io_lock;
 } _ODS5_SB_INFO;
 
 /* inode extension: mapping info from file header */
@@ -72,27 +278,167 @@ typedef struct ods5_ext_info {
 	union ods5_fm2 map[0];
 } _ODS5_EXT_INFO;
 
+/* checkpoint index of a translated file, see rms.c */
+typedef struct ods5_rms_ck {
+	loff_t out;		/* offset in the translated file */
+	loff_t in;		/* raw offset of the record */
+} _ODS5_RMS_CK;
+
+typedef struct ods5_rms {
+	loff_t size;		/* of the translated file */
+	vms_long nck;
+	struct ods5_rms_ck ck[];
+} _ODS5_RMS;
+
 /* inode extension: some file header info */
 typedef struct ods5_fh_info {
 	vms_word fid_seq;
+	struct ods5_fid backlink;
 	struct ods5_fat recattr;
+	struct ods5_rms *rms;
+	atomic_t walked;	/* extension headers walked by mapvbn */
+	struct ods5_iofile *io;	/* NULL until the file is opened */
+	struct inode *inode;
+	struct ods5_cache_ent cache;	/* for ext.next and rms */
         struct semaphore ext_lock;
 	struct ods5_ext_info ext;
 } _ODS5_FH_INFO;
 
+/* a mapped metadata block, see ods5_mread */
+typedef struct ods5_mblk {
+	struct folio *folio;
+	char *data;
+} _ODS5_MBLK;
+
 int ods5_isl_to_utf(unsigned char *utf8, unsigned int utf8len, unsigned char *name, vms_byte namelen);
+int ods5_dir_name(struct ods5_sb_info *sb_info, struct ods5_dir *dir,
+		  vms_word version, char *fn, unsigned int fnsize);
 int is_valid_home(struct ods5_home * home) ;
 int is_used_fh2(struct ods5_fh2 * fh2, struct ods5_fid fid) ;
 int mapvbn(struct super_block *sb, struct inode *inode, vms_long vbn,
 		vms_long * lbn, vms_long * extend);
-struct buffer_head *ods5_read_fh (struct super_block *sb, int fnum, 
-				  struct ods5_fh2 **fh2);
+int ods5_map_extents(union ods5_fm2 *fm2, vms_byte map_inuse,
+		void (*fn)(void *arg, vms_long count, vms_long lbn), void *arg);
+int mapvbn_nowait(struct super_block *sb, struct inode *inode, vms_long vbn,
+		vms_long * lbn, vms_long * extend);
+struct ods5_fh2 *ods5_read_fh (struct super_block *sb, int fnum,
+				struct ods5_mblk *mb);
 long ods5_ioctl (struct file *filp, unsigned int cmd, unsigned long arg);
+int ods5_sysfs_init(void);
+void ods5_sysfs_exit(void);
+int ods5_register_sysfs(struct super_block *sb);
+void ods5_unregister_sysfs(struct super_block *sb);
+void ods5_debugfs_init(void);
+void ods5_debugfs_exit(void);
+void ods5_debugfs_register(struct super_block *sb);
+void ods5_debugfs_unregister(struct super_block *sb);
+int ods5_slow_init(struct ods5_sb_info *sb_info);
+void ods5_slow_free(struct ods5_sb_info *sb_info);
+void ods5_slow_start(struct super_block *sb, struct inode *inode,
+		     struct ods5_slow_op *so);
+void ods5_slow_end(struct super_block *sb, struct inode *inode,
+		   struct ods5_slow_op *so, int op, unsigned long ino,
+		   const unsigned char *name, int namelen, vms_long blocks);
+void ods5_slow_show(struct ods5_sb_info *sb_info, struct seq_file *m);
+void ods5_iostat_init(struct ods5_sb_info *sb_info);
+void ods5_iostat_open(struct inode *inode);
+void ods5_iostat_evict(struct inode *inode);
+void ods5_iostat_get(struct inode *inode, struct ods5_iostat *st);
+ssize_t ods5_iostat_top(struct ods5_sb_info *sb_info, char *buf);
+void ods5_warm_start(struct super_block *sb);
+void ods5_warm_stop(struct super_block *sb);
+void ods5_name_cache_init(struct ods5_sb_info *sb_info);
+void ods5_name_cache_free(struct ods5_sb_info *sb_info);
+void ods5_name_cache_show(struct ods5_sb_info *sb_info, struct seq_file *m);
+void ods5_name_cache_drop(struct ods5_sb_info *sb_info,
+			  struct ods5_cache_ent *ce);
+void ods5_hdr_cache_init(struct ods5_sb_info *sb_info);
+void ods5_hdr_cache_free(struct ods5_sb_info *sb_info);
+void ods5_hdr_drop(struct ods5_sb_info *sb_info, struct ods5_cache_ent *ce);
+int ods5_hdr_get(struct ods5_sb_info *sb_info, unsigned long ino,
+		 vms_word seq, struct ods5_hdr *hdr);
+void ods5_hdr_put(struct ods5_sb_info *sb_info, unsigned long ino,
+		  struct ods5_hdr *hdr);
+void ods5_cache_init(struct ods5_sb_info *sb_info);
+int ods5_cache_register(struct super_block *sb);
+void ods5_cache_unregister(struct super_block *sb);
+void __ods5_cache_add(struct ods5_sb_info *sb_info, struct ods5_cache_ent *ce,
+		      vms_long bytes);
+void __ods5_cache_del(struct ods5_sb_info *sb_info, struct ods5_cache_ent *ce);
+void ods5_cache_trim(struct ods5_sb_info *sb_info);
+void ods5_cache_trim_all(struct ods5_sb_info *sb_info);
+void ods5_cache_charge(struct inode *inode, vms_long bytes);
+void ods5_cache_forget(struct inode *inode);
+ssize_t ods5_cache_usage(struct ods5_sb_info *sb_info, char *buf);
+long ods5_ioc_fidpath(struct file *filp, unsigned long arg);
+long ods5_ioc_search(struct file *filp, unsigned long arg);
+long ods5_ioc_versions(struct file *filp, unsigned long arg);
+long ods5_ioc_filespec(struct file *filp, unsigned long arg);
+int ods5_for_each_entry(struct inode *dir,
+			int (*fn)(void *arg, struct ods5_fid *fid), void *arg);
+long ods5_ioc_plan(struct file *filp, unsigned long arg);
+int ods5_rms_translated(struct inode *inode);
+struct ods5_rms *ods5_rms_index(struct inode *inode);
+void ods5_rms_free(struct ods5_fh_info *fh_info);
+ssize_t ods5_rms_read_iter(struct kiocb *iocb, struct iov_iter *to);
+void ods5_prefetch_init(struct super_block *sb);
+void ods5_prefetch_stop(struct super_block *sb);
+long ods5_ioc_prefetch(struct file *filp, unsigned long arg);
+long ods5_ioc_prefetch_status(struct file *filp, unsigned long arg);
+int ods5_prefetch_runs(struct super_block *sb, struct ods5_run *runs,
+		       vms_long n);
+void ods5_profile_init(struct ods5_sb_info *sb_info);
+void ods5_profile_free(struct ods5_sb_info *sb_info);
+int ods5_profile_start(struct ods5_sb_info *sb_info);
+void ods5_profile_record(struct ods5_sb_info *sb_info, vms_long lbn,
+			 vms_long count);
+long ods5_ioc_profile(struct file *filp, unsigned long arg);
+long ods5_ioc_records(struct file *filp, unsigned long arg);
+long ods5_ioc_keyed(struct file *filp, unsigned long arg);
 
 static inline struct ods5_sb_info *get_sb_info (struct super_block *sb) {
 	return sb->s_fs_info;
 }
 
+static inline void ods5_count(struct ods5_sb_info *sb_info, int stat, u64 n)
+{
+	this_cpu_add(sb_info->stats->c[stat], n);
+}
+
+/* record the read in the access profile, see profile.c */
+static inline void ods5_profile(struct ods5_sb_info *sb_info, vms_long lbn,
+				vms_long count)
+{
+	if (unlikely(READ_ONCE(sb_info->prof_on)))
+		ods5_profile_record(sb_info, lbn, count);
+}
+
+static inline void ods5_iocount(struct inode *inode, int stat, u64 n)
+{
+	struct ods5_fh_info *fh_info;
+	struct ods5_iofile *io;
+
+	fh_info = inode->i_private;
+	io = READ_ONCE(fh_info->io);
+	if (io)
+		this_cpu_add(io->c->c[stat], n);
+}
+
+static inline void ods5_count_lookup(struct ods5_sb_info *sb_info,
+				     vms_long blocks, int found)
+{
+	int h;
+
+	h = blocks <= 1 ? 0 : ilog2(blocks - 1) + 1;
+	if (h >= ODS5_LOOKUP_HIST)
+		h = ODS5_LOOKUP_HIST - 1;
+	this_cpu_inc(sb_info->stats->c[ODS5_ST_LOOKUP]);
+	if (!found)
+		this_cpu_inc(sb_info->stats->c[ODS5_ST_LOOKUP_NEG]);
+	this_cpu_add(sb_info->stats->c[ODS5_ST_LOOKUP_BLOCKS], blocks);
+	this_cpu_inc(sb_info->stats->lookup_hist[h]);
+}
+
 /*
  * Short, but not simple. The purpose is to have a common code sequence to
  * do buffer reads.
@@ -120,6 +466,141 @@ static inline struct buffer_head *ods5_bread(struct super_block *sb,
 	o = lbn - (n << sb_info->ioshifts);
 	ods5_debug(3, "lbn: %d, ioblock: %d, offset: %d\n", lbn, n, o);
 	bh = sb_bread(sb, n);
+	if (bh) {
+		ods5_count(sb_info, ODS5_ST_BREAD, 1);
+		ods5_profile(sb_info, n << sb_info->ioshifts, 1U << sb_info->ioshifts);
+	}
+	*iopos = o * ODS5_BLOCK_SIZE;
+	return bh;
+}
+
+/*
+ * Metadata reads: home block, file headers, directory and bitmap blocks.
+ * These are always single ODS5 blocks, so they don't need the sb_bread
+ * machinery with a buffer_head per block, a buffer_head lookup and the
+ * buffer_head LRU. They are read through the page cache of the block
+ * device, which is independent of the blocksize chosen for the data I/O:
+ * read the folio which contains the lbn, map it and return a pointer to the
+ * lbn's data. The caller releases the block with ods5_mrelease.
+ * The mapping is a kmap_local: it is only valid in the calling task and
+ * nested blocks must be released in the reverse order they were read.
+ * On an error NULL is returned, there is nothing to release, then.
+ */
+static inline char *ods5_mread(struct super_block *sb, vms_long lbn,
+			       struct ods5_mblk *mb)
+{
+	struct address_space *mapping;
+	struct folio *folio;
+	loff_t pos;
+
+	pos = (loff_t)lbn << ODS5_BLOCK_SHIFT;
+	mapping = sb->s_bdev->bd_inode->i_mapping;
+	ods5_debug(3, "lbn: %d, index: %lld\n", lbn, pos >> PAGE_SHIFT);
+	/* only a folio which is not yet up to date is read, and counted */
+	folio = filemap_get_folio(mapping, pos >> PAGE_SHIFT);
+	if (folio == NULL || !folio_test_uptodate(folio)) {
+		if (folio)
+			folio_put(folio);
+		folio = read_mapping_folio(mapping, pos >> PAGE_SHIFT, NULL);
+		if (IS_ERR(folio)) {
+			mb->folio = NULL;
+			mb->data = NULL;
+			return NULL;
+		}
+		ods5_count(get_sb_info(sb), ODS5_ST_MREAD, 1);
+	}
+	mb->folio = folio;
+	mb->data = kmap_local_folio(folio, offset_in_folio(folio, pos));
+	ods5_profile(get_sb_info(sb), lbn, 1);
+	return mb->data;
+}
+
+/* unmap and release a block of ods5_mread, a NULL block is ignored */
+static inline void ods5_mrelease(struct ods5_mblk *mb)
+{
+	if (mb->folio == NULL)
+		return;
+	kunmap_local(mb->data);
+	folio_put(mb->folio);
+	mb->folio = NULL;
+	mb->data = NULL;
+}
+
+/*
+ * Start reading count metadata blocks at lbn into the page cache of the
+ * block device, without waiting for the I/O. A later ods5_mread finds them.
+ */
+static inline void ods5_mreadahead(struct super_block *sb, vms_long lbn,
+				   vms_long count)
+{
+	pgoff_t index, last;
+
+	if (count == 0)
+		return;
+	index = ((loff_t)lbn << ODS5_BLOCK_SHIFT) >> PAGE_SHIFT;
+	last = ((((loff_t)lbn + count) << ODS5_BLOCK_SHIFT) - 1) >> PAGE_SHIFT;
+	{
+		DEFINE_READAHEAD(ractl, NULL, NULL,
+				 sb->s_bdev->bd_inode->i_mapping, index);
+		page_cache_ra_unbounded(&ractl, last - index + 1, 0);
+	}
+}
+
+/*
+ * Same as ods5_bread, but without I/O: the block is returned only if it is
+ * in the buffer cache and up to date, otherwise NULL.
+ */
+static inline struct buffer_head *ods5_bread_cached(struct super_block *sb,
+						    vms_long lbn, vms_long *iopos)
+{
+	struct ods5_sb_info *sb_info;
+	struct buffer_head *bh;
+	vms_long n, o;
+	sb_info = get_sb_info(sb);
+
+	n = lbn >> sb_info->ioshifts;
+	o = lbn - (n << sb_info->ioshifts);
+	bh = sb_find_get_block(sb, n);
+	if (bh != NULL && !buffer_uptodate(bh)) {
+		brelse(bh);
+		bh = NULL;
+	}
+	if (bh) {
+		ods5_count(sb_info, ODS5_ST_BREAD, 1);
+		ods5_profile(sb_info, n << sb_info->ioshifts, 1U << sb_info->ioshifts);
+	}
+	ods5_debug(3, "lbn: %d, ioblock: %d, cached: %d\n", lbn, n, bh != NULL);
+	*iopos = o * ODS5_BLOCK_SIZE;
+	return bh;
+}
+
+/*
+ * Same as ods5_bread, for the data of a file: the block is accounted as
+ * read from disk or, if it was up to date, perhaps after waiting for a read
+ * ahead, as found in the buffer cache.
+ */
+static inline struct buffer_head *ods5_bread_io(struct inode *inode,
+						vms_long lbn, vms_long *iopos)
+{
+	struct super_block *sb;
+	struct ods5_sb_info *sb_info;
+	struct buffer_head *bh;
+	vms_long n, o;
+	int ret;
+	sb = inode->i_sb;
+	sb_info = get_sb_info(sb);
+
+	n = lbn >> sb_info->ioshifts;
+	o = lbn - (n << sb_info->ioshifts);
+	bh = sb_getblk(sb, n);
+	ret = bh_read(bh, 0);
+	if (ret < 0) {
+		brelse(bh);
+		return NULL;
+	}
+	ods5_count(sb_info, ODS5_ST_BREAD, 1);
+	ods5_profile(sb_info, n << sb_info->ioshifts, 1U << sb_info->ioshifts);
+	ods5_iocount(inode, ret ? ODS5_IO_CACHED : ODS5_IO_DISK, 1);
 	*iopos = o * ODS5_BLOCK_SIZE;
 	return bh;
 }
@@ -158,7 +639,9 @@ extern void ods5_read_inode(struct inode *);
 static inline struct inode * ods5_iget (struct super_block *sb , unsigned long ino , vms_word seq) {
 	struct inode * inode;
 	inode = iget_locked(sb, ino);
-	if (inode && !(inode->i_state & I_NEW)) {
+	if (!inode)
+		return NULL;
+	if (!(inode->i_state & I_NEW)) {
 		if (((struct ods5_fh_info *)inode->i_private)->fid_seq != seq) {
 			iput(inode);
 			return NULL;
@@ -169,8 +652,7 @@ static inline struct inode * ods5_iget (struct super_block *sb , unsigned long i
 	inode->i_private = (void *)(unsigned long)seq;
 	ods5_read_inode(inode);
 	if (is_bad_inode(inode)) {
-       		iput(inode);
-		unlock_new_inode(inode);
+		iget_failed(inode);
 		return NULL;
 	}
 	unlock_new_inode(inode);
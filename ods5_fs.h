@@ -41,6 +41,10 @@
 #define ODS5_BLOCK_SHIFT	9
 #define ODS5_BLOCK_SIZE	512
 
+/* default and maximum readahead limit in KB, changeable with ra_kb= */
+#define ODS5_RA_KB	128
+#define ODS5_RA_MAXKB	16384
+
 #define ODS5_INDEXF_INO	1
 #define ODS5_BITMAP_INO	2
 #define ODS5_MFD_INO	4
@@ -58,6 +62,17 @@
 
 #define ODS5_IOC_GETFAT 0x000D5501
 #define ODS5_IOC_GETFH  0x000D5502
+#define ODS5_IOC_BULKSTAT 0x000D5503
+#define ODS5_IOC_FIDPATH 0x000D5504
+#define ODS5_IOC_SEARCH 0x000D5505
+#define ODS5_IOC_VERSIONS 0x000D5506
+#define ODS5_IOC_FILESPEC 0x000D5507
+#define ODS5_IOC_PLAN 0x000D5508
+#define ODS5_IOC_PREFETCH 0x000D5509
+#define ODS5_IOC_PREFETCH_STATUS 0x000D550A
+#define ODS5_IOC_RECORDS 0x000D550B
+#define ODS5_IOC_KEYED 0x000D550C
+#define ODS5_IOC_PROFILE 0x000D550D
 
 #define ODS5_VOL_READCHECK 0x1
 #define ODS5_VOL_WRITCHECK 0x2
@@ -236,6 +251,9 @@ typedef union ods5_fm2 {
 } _ODS5_FM2;
 CHECK(_ODS5_FM2,==,8)
 
+/* a record size of -1 ends the records in a directory block */
+#define NO_MORE_RECORDS ((vms_word)-1)
+
 /* directory record flags */
 typedef struct ods5_dirflags {
 	vms_byte type: 3;
@@ -293,5 +311,278 @@ typedef struct ods5_scb {
 } _ODS5_SCB;
 CHECK(_ODS5_SCB,==,512)
 
+/*
+ * ODS5_IOC_BULKSTAT, on the root directory:
+ * starting at file number cursor, return up to count records of the used
+ * (primary) file headers in INDEXF.SYS order into the array at buffer;
+ * on return cursor is the next file number to ask for and count the number
+ * of returned records, zero at the end of the index file.
+ */
+typedef struct ods5_bulkstat {
+	vms_quad buffer;		/* user address of ods5_bstat[count] */
+	vms_long cursor;		/* file number, (nmx << 16) + num */
+	vms_long count;
+} _ODS5_BULKSTAT;
+CHECK(_ODS5_BULKSTAT,==,16)
+
+typedef struct ods5_bstat {
+	vms_quad size;			/* bytes, from efblk and ffbyte */
+	vms_quad credate;
+	vms_quad revdate;
+	vms_quad accdate;		/* ODS5 only */
+	vms_quad attdate;		/* ODS5 only */
+	struct ods5_fch filechar;
+	vms_long blocks;		/* allocated blocks, hiblk */
+	vms_long extents;		/* retrieval pointers in the header */
+	struct vms_uic fileowner;
+	struct ods5_fid fid;
+	struct ods5_fid backlink;
+	struct ods5_fid ext_fid;	/* extension header, if any */
+	struct vms_prot fileprot;
+	vms_word linkcount;
+	vms_word struclev;
+} _ODS5_BSTAT;
+CHECK(_ODS5_BSTAT,==,80)
+
+/*
+ * ODS5_IOC_FIDPATH, on any file or directory of the volume:
+ * return the path of the file with fid, relative to the mount point and
+ * with the names as readdir shows them, as a zero terminated string into
+ * the size bytes at buffer; size is set to the length of the path,
+ * including the terminating zero. A zero seq matches any sequence number.
+ */
+typedef struct ods5_fidpath {
+	struct ods5_fid fid;
+	vms_word flags;			/* must be zero */
+	vms_long size;
+	vms_long spare;			/* must be zero */
+	vms_quad buffer;		/* user address of char[size] */
+} _ODS5_FIDPATH;
+CHECK(_ODS5_FIDPATH,==,24)
+
+/*
+ * ODS5_IOC_SEARCH, on a directory:
+ * return the entries matching the VMS wildcard pattern, for example
+ * *.COM;* or LOG_2024*.DAT;0. In the name '*' matches any number of
+ * characters and '%' a single one, the compare is case-blind; without a
+ * '.' in the name, '.*' is appended. The version can be a number, '*' or
+ * empty for all, 0 for the latest and -n for the n-th before the latest;
+ * without ';' all versions match. UCS-2 names are not searched.
+ * Start with a zero cursor and call again with the returned cursor, verskip
+ * and verindex until cursor is ODS5_SEARCH_END. A cursor which is not at
+ * a record of the directory is EINVAL.
+ */
+#define ODS5_SEARCH_END 0xffffffff
+
+typedef struct ods5_search {
+	vms_quad pattern;		/* user address of char[patlen] */
+	vms_quad buffer;		/* user address of ods5_match[count] */
+	vms_long patlen;
+	vms_long count;
+	vms_long cursor;		/* 1 + directory byte offset of a record */
+	vms_word verskip;		/* entries of that record already returned */
+	vms_word verindex;		/* versions of that name in earlier records */
+} _ODS5_SEARCH;
+CHECK(_ODS5_SEARCH,==,32)
+
+typedef struct ods5_match {
+	struct ods5_fid fid;
+	vms_word version;
+	vms_word namelen;
+	char name[758];			/* as readdir shows it, with the version */
+} _ODS5_MATCH;
+CHECK(_ODS5_MATCH,==,768)
+
+/*
+ * ODS5_IOC_VERSIONS, on a directory:
+ * return all versions of the name, without version and delimiter, as
+ * ods5_dirent entries, the highest version first. On return count is the
+ * number of versions, if that is more than the passed count, only count
+ * entries were written.
+ */
+typedef struct ods5_versions {
+	vms_quad name;			/* user address of char[namelen] */
+	vms_quad buffer;		/* user address of ods5_dirent[count] */
+	vms_long namelen;
+	vms_long count;
+} _ODS5_VERSIONS;
+CHECK(_ODS5_VERSIONS,==,24)
+
+/*
+ * ODS5_IOC_FILESPEC, on the root directory:
+ * resolve a VMS file specification, for example [PROJ.SRC.LIB]MODULE.C;7,
+ * relative to the MFD. Names are case-blind, the version can be a number,
+ * 0 or empty for the latest and -n for the n-th before the latest. Returns
+ * the fid and with ODS5_FILESPEC_OPEN an open (read-only) file descriptor.
+ */
+#define ODS5_FILESPEC_OPEN 1
+
+typedef struct ods5_filespec {
+	vms_quad spec;			/* user address of char[speclen] */
+	vms_long speclen;
+	vms_long flags;
+	struct ods5_fid fid;
+	vms_word reserved;
+	vms_long fd;			/* -1 if not opened */
+	vms_long spare;
+} _ODS5_FILESPEC;
+CHECK(_ODS5_FILESPEC,==,32)
+
+/*
+ * ODS5_IOC_PLAN, on a directory for its entries or, with a list of fids,
+ * on any file of the volume:
+ * return the extents of the (regular) files up to EOF, sorted by LBN.
+ * On return count is the number of extents; if they don't fit into the
+ * buffer, nothing is returned and the error is ERANGE.
+ */
+#define ODS5_PLAN_MAX (1 << 18)
+
+typedef struct ods5_plan {
+	vms_quad fids;			/* user address of ods5_fid[nfids] or 0 */
+	vms_quad buffer;		/* user address of ods5_plan_ext[count] */
+	vms_long nfids;
+	vms_long count;
+} _ODS5_PLAN;
+CHECK(_ODS5_PLAN,==,24)
+
+typedef struct ods5_plan_ext {
+	struct ods5_fid fid;
+	vms_word spare;
+	vms_long vbn;
+	vms_long lbn;
+	vms_long count;			/* blocks */
+} _ODS5_PLAN_EXT;
+CHECK(_ODS5_PLAN_EXT,==,20)
+
+/*
+ * ODS5_IOC_PREFETCH, on any file or directory of the volume:
+ * queue the read of the headers and the data of the files into the page
+ * cache and return. ODS5_IOC_PREFETCH_STATUS returns the progress, state
+ * is 1 (queued), 2 (running) or 3 (done). ODS5_IOC_PREFETCH needs
+ * CAP_SYS_ADMIN, the files are not checked for access.
+ */
+#define ODS5_PF_MAXFIDS 65536
+
+typedef struct ods5_prefetch {
+	vms_quad fids;			/* user address of ods5_fid[nfids] */
+	vms_long nfids;
+	vms_long flags;			/* must be zero */
+} _ODS5_PREFETCH;
+CHECK(_ODS5_PREFETCH,==,16)
+
+typedef struct ods5_pfstatus {
+	vms_long state;
+	vms_long nfids;
+	vms_long files;			/* headers read */
+	vms_long blocks;		/* blocks queued for read */
+} _ODS5_PFSTATUS;
+CHECK(_ODS5_PFSTATUS,==,16)
+
+/*
+ * ODS5_IOC_RECORDS, on a sequential file with variable length, VFC or fixed
+ * length records or on a relative file:
+ * return up to count whole records into the size bytes at buffer, with a
+ * descriptor for each. VFC records include the fixed control area. The
+ * cursor is the raw byte offset of a record or, with ODS5_RECORDS_RECNO,
+ * the record number, starting at 1; relative files need the record number,
+ * their empty and deleted cells are skipped. On return cursor is the next
+ * record to ask for, count the number of returned records, zero at EOF,
+ * and size the bytes used. If not even the first record fits, the error is
+ * ERANGE and size is its length.
+ */
+#define ODS5_RECORDS_RECNO 1
+#define ODS5_RECORDS_MAX 65536
+
+typedef struct ods5_records {
+	vms_quad buffer;		/* user address of char[size] */
+	vms_quad descs;			/* user address of ods5_recdesc[count] */
+	vms_quad cursor;
+	vms_long size;
+	vms_long count;
+	vms_long flags;
+	vms_long spare;			/* must be zero */
+} _ODS5_RECORDS;
+CHECK(_ODS5_RECORDS,==,40)
+
+typedef struct ods5_recdesc {
+	vms_quad pos;			/* raw byte offset or record number */
+	vms_long offset;		/* of the data in buffer */
+	vms_long length;
+} _ODS5_RECDESC;
+CHECK(_ODS5_RECDESC,==,16)
+
+/*
+ * ODS5_IOC_KEYED, on an indexed file:
+ * return the records with the primary key key or, with ODS5_KEYED_RANGE,
+ * from key to key2, into buffer and descs as for ODS5_IOC_RECORDS; pos is
+ * the RFA, (vbn << 16) + id. Shorter keys are generic, they compare only
+ * their length; with ODS5_KEYED_RANGE an empty key starts at the first and
+ * an empty key2 ends at the last record. Start with a zero cursor and call
+ * again with the returned cursor and offset, until cursor is zero.
+ */
+#define ODS5_KEYED_RANGE 1
+
+typedef struct ods5_keyed {
+	vms_quad key;			/* user address of char[keylen] */
+	vms_quad key2;			/* user address of char[key2len] */
+	vms_quad buffer;		/* user address of char[size] */
+	vms_quad descs;			/* user address of ods5_recdesc[count] */
+	vms_long keylen;
+	vms_long key2len;
+	vms_long size;
+	vms_long count;
+	vms_long flags;
+	vms_long cursor;		/* vbn of a data bucket */
+	vms_long offset;		/* of the next record in the bucket */
+	vms_long spare;			/* must be zero */
+} _ODS5_KEYED;
+CHECK(_ODS5_KEYED,==,64)
+
+/*
+ * ODS5_IOC_PROFILE, on any file or directory of the volume, see profile.c:
+ * op ODS5_PROFILE_START starts recording the blocks read, a previous
+ * profile is dropped, ODS5_PROFILE_STOP stops it. ODS5_PROFILE_GET returns
+ * the recorded runs of blocks, in the order they were read, in runs; on
+ * return count is the number of runs, if it didn't fit the error is ERANGE.
+ * ODS5_PROFILE_REPLAY reads count runs from runs ahead, as ODS5_IOC_PREFETCH
+ * does, and returns; ODS5_IOC_PREFETCH_STATUS shows the progress.
+ * recording is returned, 1 while the profile is recorded.
+ */
+#define ODS5_PROFILE_START 1
+#define ODS5_PROFILE_STOP 2
+#define ODS5_PROFILE_GET 3
+#define ODS5_PROFILE_REPLAY 4
+#define ODS5_PROFILE_MAX 65536
+
+typedef struct ods5_run {
+	vms_long lbn;
+	vms_long count;
+} _ODS5_RUN;
+CHECK(_ODS5_RUN,==,8)
+
+typedef struct ods5_profile {
+	vms_quad runs;			/* user address of ods5_run[count] */
+	vms_long op;
+	vms_long count;
+	vms_long recording;
+	vms_long spare;			/* must be zero */
+} _ODS5_PROFILE;
+CHECK(_ODS5_PROFILE,==,24)
+
+/*
+ * The user.ods5.iostat xattr of a file: what was read since its inode was
+ * loaded. The blocks are I/O blocks, of the size of the bs mount option;
+ * disk are those read on demand or read ahead, cached the reads served by
+ * the buffer cache.
+ */
+typedef struct ods5_iostat {
+	vms_quad bytes;			/* returned by read */
+	vms_quad disk;
+	vms_quad cached;
+	vms_quad mapvbn;		/* vbn to lbn mappings */
+	vms_quad ext_loads;		/* extension headers read */
+} _ODS5_IOSTAT;
+CHECK(_ODS5_IOSTAT,==,40)
+
 #define	_ODS5_FS_H loaded
 #endif
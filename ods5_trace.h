@@ -0,0 +1,159 @@
+/*
+ * linux/fs/ods5/ods5_trace.h
+ *
+ * This file is part of the OpenVMS ODS5 file system for Linux.
+ * Copyright (C) 2017 Hartmut Becker.
+ *
+ * The OpenVMS ODS5 file system for Linux is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The OpenVMS ODS5 file system for Linux is distributed in the hope that it
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Tracepoints, in /sys/kernel/tracing/events/ods5/. They are built in
+ * release modules, disabled they cost a not taken branch. The events are
+ * defined in super.c, with CREATE_TRACE_POINTS.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ods5
+
+#if !defined(_ODS5_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _ODS5_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(ods5_mapvbn,
+	TP_PROTO(struct inode *inode, u32 vbn, u32 lbn, u32 extent,
+		 int headers, int ret),
+	TP_ARGS(inode, vbn, lbn, extent, headers, ret),
+	TP_STRUCT__entry(
+		__field(dev_t, dev)
+		__field(unsigned long, ino)
+		__field(u32, vbn)
+		__field(u32, lbn)
+		__field(u32, extent)
+		__field(int, headers)
+		__field(int, ret)
+	),
+	TP_fast_assign(
+		__entry->dev = inode->i_sb->s_dev;
+		__entry->ino = inode->i_ino;
+		__entry->vbn = vbn;
+		__entry->lbn = lbn;
+		__entry->extent = extent;
+		__entry->headers = headers;
+		__entry->ret = ret;
+	),
+	TP_printk("dev %d:%d ino %lu vbn %u lbn %u extent %u headers %d ret %d",
+		  MAJOR(__entry->dev), MINOR(__entry->dev), __entry->ino,
+		  __entry->vbn, __entry->lbn, __entry->extent,
+		  __entry->headers, __entry->ret)
+);
+
+TRACE_EVENT(ods5_read_fh,
+	TP_PROTO(struct super_block *sb, int fnum, u32 lbn, int ok),
+	TP_ARGS(sb, fnum, lbn, ok),
+	TP_STRUCT__entry(
+		__field(dev_t, dev)
+		__field(int, fnum)
+		__field(u32, lbn)
+		__field(int, ok)
+	),
+	TP_fast_assign(
+		__entry->dev = sb->s_dev;
+		__entry->fnum = fnum;
+		__entry->lbn = lbn;
+		__entry->ok = ok;
+	),
+	TP_printk("dev %d:%d fnum %d lbn %u ok %d",
+		  MAJOR(__entry->dev), MINOR(__entry->dev), __entry->fnum,
+		  __entry->lbn, __entry->ok)
+);
+
+TRACE_EVENT(ods5_lookup,
+	TP_PROTO(struct inode *dir, const struct qstr *name, u32 blocks,
+		 int found),
+	TP_ARGS(dir, name, blocks, found),
+	TP_STRUCT__entry(
+		__field(dev_t, dev)
+		__field(unsigned long, dir)
+		__string(name, name->name)
+		__field(u32, blocks)
+		__field(int, found)
+	),
+	TP_fast_assign(
+		__entry->dev = dir->i_sb->s_dev;
+		__entry->dir = dir->i_ino;
+		__assign_str(name, name->name);
+		__entry->blocks = blocks;
+		__entry->found = found;
+	),
+	TP_printk("dev %d:%d dir %lu name %s blocks %u found %d",
+		  MAJOR(__entry->dev), MINOR(__entry->dev), __entry->dir,
+		  __get_str(name), __entry->blocks, __entry->found)
+);
+
+TRACE_EVENT(ods5_readdir,
+	TP_PROTO(struct inode *dir, u32 vbn, loff_t from, loff_t to,
+		 int entries),
+	TP_ARGS(dir, vbn, from, to, entries),
+	TP_STRUCT__entry(
+		__field(dev_t, dev)
+		__field(unsigned long, dir)
+		__field(u32, vbn)
+		__field(loff_t, from)
+		__field(loff_t, to)
+		__field(int, entries)
+	),
+	TP_fast_assign(
+		__entry->dev = dir->i_sb->s_dev;
+		__entry->dir = dir->i_ino;
+		__entry->vbn = vbn;
+		__entry->from = from;
+		__entry->to = to;
+		__entry->entries = entries;
+	),
+	TP_printk("dev %d:%d dir %lu vbn %u pos %lld..%lld entries %d",
+		  MAJOR(__entry->dev), MINOR(__entry->dev), __entry->dir,
+		  __entry->vbn, __entry->from, __entry->to, __entry->entries)
+);
+
+TRACE_EVENT(ods5_read_iter,
+	TP_PROTO(struct inode *inode, loff_t pos, size_t count, ssize_t ret),
+	TP_ARGS(inode, pos, count, ret),
+	TP_STRUCT__entry(
+		__field(dev_t, dev)
+		__field(unsigned long, ino)
+		__field(loff_t, pos)
+		__field(size_t, count)
+		__field(ssize_t, ret)
+	),
+	TP_fast_assign(
+		__entry->dev = inode->i_sb->s_dev;
+		__entry->ino = inode->i_ino;
+		__entry->pos = pos;
+		__entry->count = count;
+		__entry->ret = ret;
+	),
+	TP_printk("dev %d:%d ino %lu pos %lld count %zu ret %zd",
+		  MAJOR(__entry->dev), MINOR(__entry->dev), __entry->ino,
+		  __entry->pos, __entry->count, __entry->ret)
+);
+
+#endif /* _ODS5_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE ods5_trace
+#include <trace/define_trace.h>
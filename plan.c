@@ -0,0 +1,159 @@
+/*
+ * linux/fs/ods5/plan.c
+ *
+ * This file is part of the OpenVMS ODS5 file system for Linux.
+ * Copyright (C) 2017 Hartmut Becker.
+ *
+ * The OpenVMS ODS5 file system for Linux is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The OpenVMS ODS5 file system for Linux is distributed in the hope that it
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/capability.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/sched/signal.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/uaccess.h>
+
+#include "./ods5_fs.h"
+#include "./ods5.h"
+
+/*
+ * Read plan: the extents of a set of files, in LBN order.
+ * Reading the files of a directory in name order on an aged volume seeks
+ * all over the disk. With the extents sorted by their first LBN a copy tool
+ * can read in physical order. The extents are what mapvbn returns, that is
+ * the retrieval pointers of the file and its extension headers, up to EOF.
+ */
+
+typedef struct plan_ctx {
+	struct super_block *sb;
+	struct ods5_plan_ext *ext;
+	vms_long capacity;
+	vms_long total;
+} _PLAN_CTX;
+
+/* add the extents of the file with fid, other than regular files are skipped */
+static int plan_file(void *arg, struct ods5_fid *fid)
+{
+	struct plan_ctx *pc = arg;
+	struct inode *inode;
+	struct ods5_plan_ext *pe;
+	vms_long vbn, eofvbn;
+	vms_long lbn, extent;
+	int ret;
+
+	if (fatal_signal_pending(current))
+		return -EINTR;
+	inode = ods5_iget(pc->sb, fid->num + (fid->nmx << 16), fid->seq);
+	if (!inode)
+		return 0;
+	ret = 0;
+	if (!S_ISREG(inode->i_mode))
+		goto out;
+	eofvbn = (inode->i_size + ODS5_BLOCK_SIZE - 1) >> ODS5_BLOCK_SHIFT;
+	for (vbn = 1; vbn <= eofvbn; vbn += extent) {
+		if (!mapvbn(pc->sb, inode, vbn, &lbn, &extent)) {
+			ret = -EIO;
+			break;
+		}
+		if (extent > eofvbn - vbn + 1)
+			extent = eofvbn - vbn + 1;
+		if (pc->total < pc->capacity) {
+			pe = &pc->ext[pc->total];
+			pe->fid = *fid;
+			pe->fid.rvn = 0;
+			pe->spare = 0;
+			pe->vbn = vbn;
+			pe->lbn = lbn;
+			pe->count = extent;
+		}
+		pc->total++;
+	}
+out:
+	iput(inode);
+	cond_resched();
+	return ret;
+}
+
+static int cmp_lbn(const void *a, const void *b)
+{
+	const struct ods5_plan_ext *x = a, *y = b;
+
+	if (x->lbn < y->lbn)
+		return -1;
+	return x->lbn > y->lbn;
+}
+
+long ods5_ioc_plan(struct file *filp, unsigned long arg)
+{
+	struct inode *inode;
+	struct ods5_plan req;
+	struct plan_ctx pc;
+	struct ods5_fid fid;
+	struct ods5_fid __user *ufids;
+	vms_long i;
+	long ret;
+
+	inode = filp->f_path.dentry->d_inode;
+	if (copy_from_user(&req, (void __user *)arg, sizeof req))
+		return -EFAULT;
+	/* with a FID list, the files are not checked for access */
+	if (req.fids && !capable(CAP_SYS_ADMIN))
+		return -EPERM;
+	if (!req.fids && !S_ISDIR(inode->i_mode))
+		return -ENOTDIR;
+	if (req.count > ODS5_PLAN_MAX)
+		req.count = ODS5_PLAN_MAX;
+
+	pc.sb = inode->i_sb;
+	pc.capacity = req.count;
+	pc.total = 0;
+	pc.ext = NULL;
+	if (pc.capacity) {
+		pc.ext = kvmalloc_array(pc.capacity, sizeof *pc.ext, GFP_KERNEL);
+		if (!pc.ext)
+			return -ENOMEM;
+	}
+
+	if (req.fids) {
+		ufids = (struct ods5_fid __user *)(unsigned long)req.fids;
+		for (ret = 0, i = 0; i < req.nfids && ret == 0; i++) {
+			if (copy_from_user(&fid, &ufids[i], sizeof fid))
+				ret = -EFAULT;
+			else
+				ret = plan_file(&pc, &fid);
+		}
+	} else
+		ret = ods5_for_each_entry(inode, plan_file, &pc);
+	if (ret)
+		goto out;
+	ods5_debug(2, "extents: %d, capacity: %d\n", pc.total, pc.capacity);
+
+	/* too many, tell how many */
+	if (pc.total > pc.capacity)
+		ret = -ERANGE;
+	else {
+		sort(pc.ext, pc.total, sizeof *pc.ext, cmp_lbn, NULL);
+		if (pc.total && copy_to_user((void __user *)(unsigned long)req.buffer,
+					     pc.ext, pc.total * sizeof *pc.ext))
+			ret = -EFAULT;
+	}
+	req.count = pc.total;
+	if (copy_to_user((void __user *)arg, &req, sizeof req))
+		ret = -EFAULT;
+out:
+	kvfree(pc.ext);
+	return ret;
+}
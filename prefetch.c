@@ -0,0 +1,291 @@
+/*
+ * linux/fs/ods5/prefetch.c
+ *
+ * This file is part of the OpenVMS ODS5 file system for Linux.
+ * Copyright (C) 2017 Hartmut Becker.
+ *
+ * The OpenVMS ODS5 file system for Linux is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The OpenVMS ODS5 file system for Linux is distributed in the hope that it
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/uaccess.h>
+#include <linux/workqueue.h>
+
+#include "./ods5_fs.h"
+#include "./ods5.h"
+
+/*
+ * Prefetch of a batch of files, ODS5_IOC_PREFETCH.
+ * The ioctl only takes the list of FIDs and queues the work, it doesn't
+ * wait. In the background, first the file headers are read ahead: their
+ * lbns are mapped through INDEXF.SYS, sorted and merged into runs. Then
+ * the inodes are read, which decodes the headers and, with the mapping of
+ * all vbns, the extension headers. That gives the data extents, which are
+ * again sorted by lbn, merged and read ahead. Everything goes into the page
+ * cache of the block device, where ods5_mread and ods5_bread find it.
+ * Not more than ODS5_PF_INFLIGHT blocks are queued without waiting: then
+ * the first block of the previous run is read, which waits for its I/O.
+ * One batch per volume at a time, the progress is in
+ * /sys/fs/ods5/<device>/prefetch_* and ODS5_IOC_PREFETCH_STATUS.
+ * A batch can also be the runs of a recorded access profile, see
+ * profile.c, which are read ahead the same way.
+ */
+
+/* runs collected before they are sorted and read ahead */
+#define ODS5_PF_RUNS	4096
+
+static int pf_stopped(struct ods5_sb_info *sb_info)
+{
+	return READ_ONCE(sb_info->pf_state) == ODS5_WARM_STOPPED;
+}
+
+static int cmp_run(const void *a, const void *b)
+{
+	const struct ods5_run *x = a, *y = b;
+
+	if (x->lbn < y->lbn)
+		return -1;
+	return x->lbn > y->lbn;
+}
+
+/* sort and merge the runs, read them ahead with the in-flight limit */
+static void pf_issue(struct super_block *sb, struct ods5_run *runs, int n)
+{
+	struct ods5_sb_info *sb_info;
+	struct ods5_mblk mb;
+	vms_long lbn, count, chunk, inflight, pending;
+	int i, m;
+
+	sb_info = get_sb_info(sb);
+	if (n == 0)
+		return;
+	sort(runs, n, sizeof *runs, cmp_run, NULL);
+	for (i = 1, m = 0; i < n; i++) {
+		if (runs[i].lbn <= runs[m].lbn + runs[m].count) {
+			if (runs[i].lbn + runs[i].count > runs[m].lbn + runs[m].count)
+				runs[m].count = runs[i].lbn + runs[i].count - runs[m].lbn;
+		} else
+			runs[++m] = runs[i];
+	}
+	n = m + 1;
+	ods5_debug(2, "runs: %d\n", n);
+
+	inflight = 0;
+	pending = 0;
+	for (i = 0; i < n && !pf_stopped(sb_info); i++) {
+		lbn = runs[i].lbn;
+		for (count = runs[i].count; count; count -= chunk, lbn += chunk) {
+			chunk = count;
+			if (chunk > ODS5_PF_INFLIGHT)
+				chunk = ODS5_PF_INFLIGHT;
+			if (inflight + chunk > ODS5_PF_INFLIGHT) {
+				/* wait for the previous run */
+				if (ods5_mread(sb, pending, &mb))
+					ods5_mrelease(&mb);
+				inflight = 0;
+			}
+			ods5_mreadahead(sb, lbn, chunk);
+			atomic_add(chunk, &sb_info->pf_blocks);
+			inflight += chunk;
+			pending = lbn;
+			cond_resched();
+		}
+	}
+}
+
+static void pf_work(struct work_struct *work)
+{
+	struct ods5_sb_info *sb_info;
+	struct super_block *sb;
+	struct inode *indexf_inode;
+	struct inode *inode;
+	struct ods5_run *runs;
+	struct ods5_fid *fid;
+	vms_long i, ino, vbn, eofvbn, lbn, extent;
+	int n;
+
+	sb_info = container_of(work, struct ods5_sb_info, pf_work);
+	sb = sb_info->sb;
+	if (cmpxchg(&sb_info->pf_state, ODS5_WARM_QUEUED, ODS5_WARM_RUNNING)
+	    != ODS5_WARM_QUEUED)
+		goto out;
+	runs = NULL;
+	indexf_inode = NULL;
+	if (sb_info->pf_runs) {
+		pf_issue(sb, sb_info->pf_runs, sb_info->pf_nruns);
+		goto done;
+	}
+	runs = kvmalloc_array(ODS5_PF_RUNS, sizeof *runs, GFP_KERNEL);
+	indexf_inode = ods5_iget(sb, ODS5_INDEXF_INO, ODS5_INDEXF_INO);
+	if (!runs || !indexf_inode)
+		goto done;
+
+	/* the file headers */
+	for (i = n = 0; i < sb_info->pf_nfids && !pf_stopped(sb_info); i++) {
+		fid = &sb_info->pf_fids[i];
+		ino = fid->num + (fid->nmx << 16);
+		if (ino <= ODS5_LAST_FIXED_FH || ino > sb_info->maxfiles)
+			continue;
+		vbn = sb_info->clustersize * 4 + sb_info->ibmapsize + ino;
+		if (!mapvbn(sb, indexf_inode, vbn, &lbn, &extent))
+			continue;
+		runs[n].lbn = lbn;
+		runs[n++].count = 1;
+		if (n == ODS5_PF_RUNS) {
+			pf_issue(sb, runs, n);
+			n = 0;
+		}
+	}
+	pf_issue(sb, runs, n);
+
+	/* the extension headers and the data */
+	for (i = n = 0; i < sb_info->pf_nfids && !pf_stopped(sb_info); i++) {
+		fid = &sb_info->pf_fids[i];
+		ino = fid->num + (fid->nmx << 16);
+		if (ino == 0 || ino > sb_info->maxfiles)
+			continue;
+		inode = ods5_iget(sb, ino, fid->seq);
+		if (!inode)
+			continue;
+		atomic_inc(&sb_info->pf_files);
+		eofvbn = 0;
+		if (S_ISREG(inode->i_mode))
+			eofvbn = (inode->i_size + ODS5_BLOCK_SIZE - 1) >> ODS5_BLOCK_SHIFT;
+		for (vbn = 1; vbn <= eofvbn; vbn += extent) {
+			if (!mapvbn(sb, inode, vbn, &lbn, &extent))
+				break;
+			if (extent > eofvbn - vbn + 1)
+				extent = eofvbn - vbn + 1;
+			runs[n].lbn = lbn;
+			runs[n++].count = extent;
+			if (n == ODS5_PF_RUNS) {
+				pf_issue(sb, runs, n);
+				n = 0;
+			}
+		}
+		iput(inode);
+	}
+	pf_issue(sb, runs, n);
+
+done:
+	if (indexf_inode)
+		iput(indexf_inode);
+	kvfree(runs);
+	cmpxchg(&sb_info->pf_state, ODS5_WARM_RUNNING, ODS5_WARM_DONE);
+out:
+	kvfree(sb_info->pf_fids);
+	sb_info->pf_fids = NULL;
+	kvfree(sb_info->pf_runs);
+	sb_info->pf_runs = NULL;
+}
+
+void ods5_prefetch_init(struct super_block *sb)
+{
+	struct ods5_sb_info *sb_info;
+
+	sb_info = get_sb_info(sb);
+	INIT_WORK(&sb_info->pf_work, pf_work);
+	sb_info->pf_state = ODS5_WARM_OFF;
+}
+
+/* like ods5_warm_stop, before the inodes are evicted */
+void ods5_prefetch_stop(struct super_block *sb)
+{
+	struct ods5_sb_info *sb_info;
+
+	sb_info = get_sb_info(sb);
+	cmpxchg(&sb_info->pf_state, ODS5_WARM_QUEUED, ODS5_WARM_STOPPED);
+	cmpxchg(&sb_info->pf_state, ODS5_WARM_RUNNING, ODS5_WARM_STOPPED);
+	cancel_work_sync(&sb_info->pf_work);
+	kvfree(sb_info->pf_fids);
+	sb_info->pf_fids = NULL;
+	kvfree(sb_info->pf_runs);
+	sb_info->pf_runs = NULL;
+}
+
+/* queue a batch of fids or runs, which is freed when it is done */
+static int pf_queue(struct ods5_sb_info *sb_info, struct ods5_fid *fids,
+		    vms_long nfids, struct ods5_run *runs, vms_long nruns)
+{
+	int state;
+
+	/* one batch at a time; a finished one can be replaced */
+	state = READ_ONCE(sb_info->pf_state);
+	if ((state != ODS5_WARM_OFF && state != ODS5_WARM_DONE)
+	    || cmpxchg(&sb_info->pf_state, state, ODS5_WARM_QUEUED) != state) {
+		kvfree(fids);
+		kvfree(runs);
+		return -EBUSY;
+	}
+	/* the previous work has finished, it doesn't use the fields */
+	flush_work(&sb_info->pf_work);
+	sb_info->pf_fids = fids;
+	sb_info->pf_nfids = nfids;
+	sb_info->pf_runs = runs;
+	sb_info->pf_nruns = nruns;
+	atomic_set(&sb_info->pf_files, 0);
+	atomic_set(&sb_info->pf_blocks, 0);
+	queue_work(system_unbound_wq, &sb_info->pf_work);
+	return 0;
+}
+
+/* read ahead the runs of a profile, see profile.c */
+int ods5_prefetch_runs(struct super_block *sb, struct ods5_run *runs,
+		       vms_long n)
+{
+	return pf_queue(get_sb_info(sb), NULL, 0, runs, n);
+}
+
+long ods5_ioc_prefetch(struct file *filp, unsigned long arg)
+{
+	struct ods5_sb_info *sb_info;
+	struct ods5_prefetch req;
+	struct ods5_fid *fids;
+
+	sb_info = get_sb_info(filp->f_path.dentry->d_sb);
+	/* the files are not checked for access, and the batch is per volume */
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+	if (copy_from_user(&req, (void __user *)arg, sizeof req))
+		return -EFAULT;
+	if (req.nfids == 0 || req.nfids > ODS5_PF_MAXFIDS || req.flags)
+		return -EINVAL;
+	fids = kvmalloc_array(req.nfids, sizeof *fids, GFP_KERNEL);
+	if (!fids)
+		return -ENOMEM;
+	if (copy_from_user(fids, (void __user *)(unsigned long)req.fids,
+			   req.nfids * sizeof *fids)) {
+		kvfree(fids);
+		return -EFAULT;
+	}
+	return pf_queue(sb_info, fids, req.nfids, NULL, 0);
+}
+
+long ods5_ioc_prefetch_status(struct file *filp, unsigned long arg)
+{
+	struct ods5_sb_info *sb_info;
+	struct ods5_pfstatus st;
+
+	sb_info = get_sb_info(filp->f_path.dentry->d_sb);
+	st.state = READ_ONCE(sb_info->pf_state);
+	st.nfids = sb_info->pf_nfids;
+	st.files = atomic_read(&sb_info->pf_files);
+	st.blocks = atomic_read(&sb_info->pf_blocks);
+	if (copy_to_user((void __user *)arg, &st, sizeof st))
+		return -EFAULT;
+	return 0;
+}
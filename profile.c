@@ -0,0 +1,203 @@
+/*
+ * linux/fs/ods5/profile.c
+ *
+ * This file is part of the OpenVMS ODS5 file system for Linux.
+ * Copyright (C) 2017 Hartmut Becker.
+ *
+ * The OpenVMS ODS5 file system for Linux is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The OpenVMS ODS5 file system for Linux is distributed in the hope that it
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/blkdev.h>
+#include <linux/capability.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+
+#include "./ods5_fs.h"
+#include "./ods5.h"
+
+/*
+ * Access profiles, ODS5_IOC_PROFILE.
+ * While a profile is recorded, every block the driver reads, headers,
+ * directory and other metadata blocks with ods5_mread and data blocks with
+ * ods5_bread, is appended to the profile of the volume, in the order of the
+ * reads; a block which follows the last run extends it. Recording starts
+ * with the mount option profile or with ODS5_PROFILE_START and ends with
+ * ODS5_PROFILE_STOP or when ODS5_PROFILE_MAX runs are recorded. The runs
+ * are returned with ODS5_PROFILE_GET, to be saved in a file. After the next
+ * boot ODS5_PROFILE_REPLAY hands them to the prefetch work, which sorts,
+ * merges and reads them ahead into the page cache of the block device, as
+ * for ODS5_IOC_PREFETCH, where its progress is shown.
+ * Not recording costs a test of prof_on per read. The control operations
+ * are serialized with prof_mutex, the reads with prof_lock.
+ */
+
+void ods5_profile_init(struct ods5_sb_info *sb_info)
+{
+	mutex_init(&sb_info->prof_mutex);
+	spin_lock_init(&sb_info->prof_lock);
+	sb_info->prof = NULL;
+	sb_info->prof_count = 0;
+	sb_info->prof_on = 0;
+}
+
+void ods5_profile_free(struct ods5_sb_info *sb_info)
+{
+	WRITE_ONCE(sb_info->prof_on, 0);
+	kvfree(sb_info->prof);
+	sb_info->prof = NULL;
+}
+
+/* start a new profile, the previous one is dropped */
+int ods5_profile_start(struct ods5_sb_info *sb_info)
+{
+	struct ods5_run *prof, *old;
+
+	prof = kvmalloc_array(ODS5_PROFILE_MAX, sizeof *prof, GFP_KERNEL);
+	if (prof == NULL)
+		return -ENOMEM;
+	mutex_lock(&sb_info->prof_mutex);
+	spin_lock(&sb_info->prof_lock);
+	old = sb_info->prof;
+	sb_info->prof = prof;
+	sb_info->prof_count = 0;
+	WRITE_ONCE(sb_info->prof_on, 1);
+	spin_unlock(&sb_info->prof_lock);
+	mutex_unlock(&sb_info->prof_mutex);
+	kvfree(old);
+	return 0;
+}
+
+/* called from the read functions while prof_on is set */
+void ods5_profile_record(struct ods5_sb_info *sb_info, vms_long lbn,
+			 vms_long count)
+{
+	struct ods5_run *run;
+
+	spin_lock(&sb_info->prof_lock);
+	if (!sb_info->prof_on)
+		goto out;
+	if (sb_info->prof_count) {
+		run = &sb_info->prof[sb_info->prof_count - 1];
+		/* the same block again, or the next one */
+		if (lbn >= run->lbn && lbn + count <= run->lbn + run->count)
+			goto out;
+		if (lbn == run->lbn + run->count) {
+			run->count += count;
+			goto out;
+		}
+	}
+	if (sb_info->prof_count == ODS5_PROFILE_MAX) {
+		ods5_info("%s: profile full, recording stopped\n",
+			  sb_info->sb->s_id);
+		WRITE_ONCE(sb_info->prof_on, 0);
+		goto out;
+	}
+	run = &sb_info->prof[sb_info->prof_count++];
+	run->lbn = lbn;
+	run->count = count;
+out:
+	spin_unlock(&sb_info->prof_lock);
+}
+
+static long profile_get(struct ods5_sb_info *sb_info,
+			struct ods5_profile *req)
+{
+	vms_long n;
+	long ret;
+
+	ret = 0;
+	mutex_lock(&sb_info->prof_mutex);
+	spin_lock(&sb_info->prof_lock);
+	n = sb_info->prof_count;
+	spin_unlock(&sb_info->prof_lock);
+	/* while recording, the runs up to n are only extended */
+	if (req->count < n)
+		ret = -ERANGE;
+	else if (n && copy_to_user((void __user *)(unsigned long)req->runs,
+				   sb_info->prof, n * sizeof *sb_info->prof))
+		ret = -EFAULT;
+	mutex_unlock(&sb_info->prof_mutex);
+	req->count = n;
+	return ret;
+}
+
+static long profile_replay(struct super_block *sb, struct ods5_profile *req)
+{
+	struct ods5_run *runs;
+	sector_t blocks;
+	vms_long i, n;
+
+	if (req->count == 0 || req->count > ODS5_PROFILE_MAX)
+		return -EINVAL;
+	runs = kvmalloc_array(req->count, sizeof *runs, GFP_KERNEL);
+	if (runs == NULL)
+		return -ENOMEM;
+	if (copy_from_user(runs, (void __user *)(unsigned long)req->runs,
+			   req->count * sizeof *runs)) {
+		kvfree(runs);
+		return -EFAULT;
+	}
+	/* a profile of another volume: drop what isn't on this one */
+	blocks = bdev_nr_sectors(sb->s_bdev);
+	for (i = n = 0; i < req->count; i++) {
+		if (runs[i].count == 0 || runs[i].lbn >= blocks
+		    || runs[i].count > blocks - runs[i].lbn)
+			continue;
+		runs[n++] = runs[i];
+	}
+	return ods5_prefetch_runs(sb, runs, n);
+}
+
+long ods5_ioc_profile(struct file *filp, unsigned long arg)
+{
+	struct super_block *sb;
+	struct ods5_sb_info *sb_info;
+	struct ods5_profile req;
+	long ret;
+
+	/* the profile shows what every user of the volume read */
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+	sb = filp->f_path.dentry->d_sb;
+	sb_info = get_sb_info(sb);
+	if (copy_from_user(&req, (void __user *)arg, sizeof req))
+		return -EFAULT;
+	if (req.spare)
+		return -EINVAL;
+	switch (req.op) {
+	case ODS5_PROFILE_START:
+		ret = ods5_profile_start(sb_info);
+		break;
+	case ODS5_PROFILE_STOP:
+		WRITE_ONCE(sb_info->prof_on, 0);
+		ret = 0;
+		break;
+	case ODS5_PROFILE_GET:
+		ret = profile_get(sb_info, &req);
+		break;
+	case ODS5_PROFILE_REPLAY:
+		ret = profile_replay(sb, &req);
+		break;
+	default:
+		return -EINVAL;
+	}
+	req.recording = READ_ONCE(sb_info->prof_on);
+	if ((ret == 0 || ret == -ERANGE)
+	    && copy_to_user((void __user *)arg, &req, sizeof req))
+		return -EFAULT;
+	return ret;
+}
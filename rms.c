@@ -0,0 +1,1057 @@
+/*
+ * linux/fs/ods5/rms.c
+ *
+ * This file is part of the OpenVMS ODS5 file system for Linux.
+ * Copyright (C) 2017 Hartmut Becker.
+ *
+ * The OpenVMS ODS5 file system for Linux is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The OpenVMS ODS5 file system for Linux is distributed in the hope that it
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/sched/signal.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/uio.h>
+#include <asm/unaligned.h>
+
+#include "./ods5_fs.h"
+#include "./ods5.h"
+
+/*
+ * Record translation, mount option records.
+ * Sequential files with variable length records, with or without fixed
+ * control (VFC), are shown as a stream of lines: the record length words
+ * and the padding are removed and the carriage control is applied:
+ * implied carriage control ends each record with a LF, Fortran carriage
+ * control interprets the first byte of the record, print file carriage
+ * control the two bytes of the fixed control area. Without carriage control
+ * the records are just concatenated.
+ * The size of the translated file is only known after a scan of all
+ * records. That scan is done once, when the file is opened or stat'ed, and
+ * it leaves a checkpoint index: for every ODS5_RMS_CKPT-th record the
+ * translated and the raw offset. A read at any position does a binary
+ * search in the index and decodes at most ODS5_RMS_CKPT records to get to
+ * the position. The index is kept with the inode.
+ *
+ * Line ending translation, mount option crlf.
+ * Stream files with CR terminators (STREAMCR) are shown with LF instead,
+ * that is one to one, the size doesn't change. RMS-11 stream files (STREAM)
+ * are shown with LF for CRLF: here the size is known after a scan, which
+ * builds the same kind of checkpoint index, every ODS5_STREAM_CKPT raw
+ * bytes. The CRs are searched a word at a time, the runs between them are
+ * copied with memcpy.
+ *
+ * Whole records, ODS5_IOC_RECORDS.
+ * Independent of the mount options, the records of sequential files with
+ * variable length, VFC and fixed length records and of relative files are
+ * returned as they are, with a descriptor for each. Fixed length records
+ * and the cells of relative files have a fixed size, so record number K is
+ * at a computed offset: with NOSPAN or in the buckets of a relative file
+ * the records don't cross a block or bucket boundary.
+ */
+
+/* a record as it is decoded */
+typedef struct rms_rec {
+	loff_t data;		/* raw offset of the data */
+	vms_word len;
+	vms_word pre_n;		/* pre_n times pre_c before the data */
+	vms_word post_n;	/* post_n times post_c after the data */
+	char pre_c;
+	char post_c;
+} _RMS_REC;
+
+/* sequential access to the raw bytes, one mapped block at a time */
+typedef struct rms_reader {
+	struct inode *inode;
+	struct buffer_head *bh;
+	char *data;
+	vms_long vbn;
+	loff_t rawsize;
+	struct ods5_fat *fat;
+} _RMS_READER;
+
+static inline loff_t rms_outlen(struct rms_rec *rec)
+{
+	return rec->pre_n + rec->len + rec->post_n;
+}
+
+static void rr_init(struct rms_reader *rr, struct inode *inode)
+{
+	struct ods5_fh_info *fh_info;
+	vms_long efblk;
+
+	fh_info = inode->i_private;
+	rr->inode = inode;
+	rr->bh = NULL;
+	rr->data = NULL;
+	rr->vbn = 0;
+	rr->fat = &fh_info->recattr;
+	efblk = (rr->fat->efblk.high << 16) + rr->fat->efblk.low;
+	rr->rawsize = 0;
+	if (efblk)
+		rr->rawsize = ((loff_t)efblk - 1) * ODS5_BLOCK_SIZE
+			+ rr->fat->ffbyte;
+}
+
+static void rr_done(struct rms_reader *rr)
+{
+	brelse(rr->bh);
+	rr->bh = NULL;
+	rr->vbn = 0;
+}
+
+/* map the block with the raw offset off, return the bytes from there */
+static char *rr_map(struct rms_reader *rr, loff_t off, vms_long *avail)
+{
+	vms_long vbn, lbn, unused, iopos;
+
+	vbn = (off >> ODS5_BLOCK_SHIFT) + 1;
+	if (vbn != rr->vbn) {
+		rr_done(rr);
+		if (!mapvbn(rr->inode->i_sb, rr->inode, vbn, &lbn, &unused))
+			return NULL;
+		rr->bh = ods5_bread_io(rr->inode, lbn, &iopos);
+		if (rr->bh == NULL) {
+			ods5_debug(1, "ods5_bread of lbn %d failed\n", lbn);
+			return NULL;
+		}
+		rr->data = rr->bh->b_data + iopos;
+		rr->vbn = vbn;
+	}
+	*avail = ODS5_BLOCK_SIZE - (off & (ODS5_BLOCK_SIZE - 1));
+	return rr->data + (off & (ODS5_BLOCK_SIZE - 1));
+}
+
+static int rr_get(struct rms_reader *rr, loff_t off, void *buf, vms_long len)
+{
+	vms_long n;
+	char *p;
+
+	while (len) {
+		p = rr_map(rr, off, &n);
+		if (p == NULL)
+			return -EIO;
+		if (n > len)
+			n = len;
+		memcpy(buf, p, n);
+		buf += n;
+		off += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* one print file carriage control byte */
+static void printcc(vms_byte b, char *c, vms_word *n)
+{
+	*n = 0;
+	if (b == 0)
+		return;
+	if ((b & 0x80) == 0) {
+		*c = '\n';
+		*n = b & 0x7f;
+	} else if ((b & 0xe0) == 0x80 && (b & 0x1f) != '\r') {
+		*c = b & 0x1f;
+		*n = 1;
+	}
+}
+
+/*
+ * Find the variable length record at or after the raw offset *off, return
+ * its data and length and advance *off to the next one.
+ * Returns 1 for a record, 0 at EOF.
+ */
+static int rms_rcw(struct rms_reader *rr, loff_t *off, loff_t *data,
+		   vms_long *count)
+{
+	vms_byte rcw[2];
+	int ret;
+
+	for (;;) {
+		*off = (*off + 1) & ~(loff_t)1;
+		if (*off + 2 > rr->rawsize)
+			return 0;
+		ret = rr_get(rr, *off, rcw, 2);
+		if (ret)
+			return ret;
+		if (rr->fat->rattrib.msbrcw)
+			*count = (rcw[0] << 8) + rcw[1];
+		else
+			*count = rcw[0] + (rcw[1] << 8);
+		/* no more records in this block */
+		if (*count == 0xffff) {
+			*off = (*off | (ODS5_BLOCK_SIZE - 1)) + 1;
+			continue;
+		}
+		break;
+	}
+	*data = *off + 2;
+	if (*data + *count > rr->rawsize)
+		*count = rr->rawsize - *data;
+	*off = *data + *count;
+	return 1;
+}
+
+/*
+ * Decode the record at the raw offset *off and advance *off to the next one.
+ * Returns 1 for a record, 0 at EOF.
+ */
+static int rms_next(struct rms_reader *rr, loff_t *off, struct rms_rec *rec)
+{
+	vms_byte ctl[2];
+	vms_long count, fsz;
+	int ret;
+
+	ret = rms_rcw(rr, off, &rec->data, &count);
+	if (ret <= 0)
+		return ret;
+	rec->pre_n = rec->post_n = 0;
+	rec->pre_c = rec->post_c = '\n';
+
+	if (rr->fat->rtype.rtype == FAT_VFC) {
+		fsz = rr->fat->vfcsize ? rr->fat->vfcsize : 2;
+		if (fsz > count)
+			fsz = count;
+		if (rr->fat->rattrib.printcc && fsz >= 2) {
+			ret = rr_get(rr, rec->data, ctl, 2);
+			if (ret)
+				return ret;
+			printcc(ctl[0], &rec->pre_c, &rec->pre_n);
+			printcc(ctl[1], &rec->post_c, &rec->post_n);
+		}
+		rec->data += fsz;
+		count -= fsz;
+	}
+	rec->len = count;
+
+	if (rr->fat->rattrib.fortrancc) {
+		ctl[0] = ' ';
+		if (rec->len) {
+			ret = rr_get(rr, rec->data, ctl, 1);
+			if (ret)
+				return ret;
+			rec->data++;
+			rec->len--;
+		}
+		switch (ctl[0]) {
+		    case '0':
+			rec->pre_n = 1;
+			break;
+		    case '1':
+			rec->pre_c = '\f';
+			rec->pre_n = 1;
+			break;
+		}
+		if (ctl[0] != '$')
+			rec->post_n = 1;
+	} else if (rr->fat->rattrib.impliedcc)
+		rec->post_n = 1;
+	return 1;
+}
+
+/* is the file shown translated, and how? */
+int ods5_rms_translated(struct inode *inode)
+{
+	struct ods5_sb_info *sb_info;
+	struct ods5_fh_info *fh_info;
+	struct ods5_fat *fat;
+
+	sb_info = get_sb_info(inode->i_sb);
+	if ((!sb_info->records && !sb_info->crlf) || !S_ISREG(inode->i_mode))
+		return ODS5_XLATE_NONE;
+	fh_info = inode->i_private;
+	fat = &fh_info->recattr;
+	if (fat->rtype.fileorg != FAT_SEQUENTIAL)
+		return ODS5_XLATE_NONE;
+	switch (fat->rtype.rtype) {
+	    case FAT_VARIABLE:
+	    case FAT_VFC:
+		if (sb_info->records)
+			return ODS5_XLATE_RECORDS;
+		break;
+	    case FAT_STREAMCR:
+		if (sb_info->crlf)
+			return ODS5_XLATE_CR;
+		break;
+	    case FAT_STREAM:
+		if (sb_info->crlf)
+			return ODS5_XLATE_CRLF;
+		break;
+	}
+	return ODS5_XLATE_NONE;
+}
+
+/* the index of the first CR in p[0..n-1], or n */
+static size_t find_cr(const char *p, size_t n)
+{
+	const unsigned long ones = REPEAT_BYTE(0x01);
+	const unsigned long highs = REPEAT_BYTE(0x80);
+	const unsigned long crs = REPEAT_BYTE('\r');
+	unsigned long w;
+	size_t i;
+
+	/* a zero byte in w is a CR in p */
+	for (i = 0; i + sizeof w <= n; i += sizeof w) {
+		w = get_unaligned((const unsigned long *)(p + i)) ^ crs;
+		if ((w - ones) & ~w & highs)
+			break;
+	}
+	for (; i < n; i++)
+		if (p[i] == '\r')
+			break;
+	return i;
+}
+
+/*
+ * Translate the line endings of p[0..n-1] into dst, or just count the
+ * result if dst is NULL. For crlf, next_lf tells if the byte after p[n-1]
+ * is a LF. Returns the length of the result.
+ */
+static size_t xlate_chunk(const char *p, size_t n, char *dst, int crlf,
+			  int next_lf)
+{
+	size_t i, j, m;
+
+	for (i = m = 0; i < n; i = j + 1) {
+		j = i + find_cr(p + i, n - i);
+		if (dst)
+			memcpy(dst + m, p + i, j - i);
+		m += j - i;
+		if (j == n)
+			break;
+		if (crlf) {
+			/* drop the CR of a CRLF */
+			if (j + 1 < n ? p[j + 1] == '\n' : next_lf)
+				continue;
+			if (dst)
+				dst[m] = '\r';
+		} else if (dst)
+			dst[m] = '\n';
+		m++;
+	}
+	return m;
+}
+
+/*
+ * Map the stream bytes at off, up to the end of the block or EOF; for crlf
+ * also look at the first byte of the next block.
+ */
+static char *stream_map(struct rms_reader *rr, loff_t off, vms_long *n,
+			int crlf, int *next_lf)
+{
+	char *p;
+	char c;
+
+	p = rr_map(rr, off, n);
+	if (p == NULL)
+		return NULL;
+	if (*n > rr->rawsize - off)
+		*n = rr->rawsize - off;
+	*next_lf = 0;
+	if (crlf && p[*n - 1] == '\r' && off + *n < rr->rawsize) {
+		if (rr_get(rr, off + *n, &c, 1))
+			return NULL;
+		*next_lf = c == '\n';
+		p = rr_map(rr, off, n);
+		if (p != NULL && *n > rr->rawsize - off)
+			*n = rr->rawsize - off;
+	}
+	return p;
+}
+
+static struct ods5_rms *stream_build(struct inode *inode)
+{
+	struct rms_reader rr;
+	struct ods5_rms *rms;
+	loff_t off, out;
+	vms_long n, nck;
+	int next_lf, ret;
+	char *p;
+
+	rr_init(&rr, inode);
+	nck = (rr.rawsize + ODS5_STREAM_CKPT - 1) / ODS5_STREAM_CKPT;
+	rms = kvmalloc(struct_size(rms, ck, nck ? nck : 1), GFP_KERNEL);
+	if (!rms)
+		return ERR_PTR(-ENOMEM);
+	rms->nck = 0;
+	ret = 0;
+	for (off = out = 0; off < rr.rawsize; off += n) {
+		if ((off & (ODS5_STREAM_CKPT - 1)) == 0) {
+			rms->ck[rms->nck].out = out;
+			rms->ck[rms->nck].in = off;
+			rms->nck++;
+			if (fatal_signal_pending(current)) {
+				ret = -EINTR;
+				break;
+			}
+			cond_resched();
+		}
+		p = stream_map(&rr, off, &n, 1, &next_lf);
+		if (p == NULL) {
+			ret = -EIO;
+			break;
+		}
+		out += xlate_chunk(p, n, NULL, 1, next_lf);
+	}
+	rr_done(&rr);
+	if (ret < 0) {
+		kvfree(rms);
+		return ERR_PTR(ret);
+	}
+	rms->size = out;
+	ods5_debug(2, "checkpoints: %d, size: %Ld, raw: %Ld\n",
+		   rms->nck, out, rr.rawsize);
+	return rms;
+}
+
+static struct ods5_rms *rms_build(struct inode *inode)
+{
+	struct rms_reader rr;
+	struct rms_rec rec;
+	struct ods5_rms *rms, *tmp;
+	loff_t off, in, out;
+	vms_long nrec, cap;
+	int ret;
+
+	cap = 64;
+	rms = kvmalloc(struct_size(rms, ck, cap), GFP_KERNEL);
+	if (!rms)
+		return ERR_PTR(-ENOMEM);
+	rms->nck = 0;
+	rr_init(&rr, inode);
+	off = out = 0;
+	nrec = 0;
+	for (;;) {
+		in = off;
+		ret = rms_next(&rr, &off, &rec);
+		if (ret <= 0)
+			break;
+		if (nrec % ODS5_RMS_CKPT == 0) {
+			if (rms->nck == cap) {
+				tmp = kvmalloc(struct_size(rms, ck, cap * 2), GFP_KERNEL);
+				if (!tmp) {
+					ret = -ENOMEM;
+					break;
+				}
+				memcpy(tmp, rms, struct_size(rms, ck, cap));
+				kvfree(rms);
+				rms = tmp;
+				cap *= 2;
+			}
+			rms->ck[rms->nck].out = out;
+			rms->ck[rms->nck].in = in;
+			rms->nck++;
+			if (fatal_signal_pending(current)) {
+				ret = -EINTR;
+				break;
+			}
+			cond_resched();
+		}
+		out += rms_outlen(&rec);
+		nrec++;
+	}
+	rr_done(&rr);
+	if (ret < 0) {
+		kvfree(rms);
+		return ERR_PTR(ret);
+	}
+	rms->size = out;
+	ods5_debug(2, "records: %d, checkpoints: %d, size: %Ld, raw: %Ld\n",
+		   nrec, rms->nck, out, rr.rawsize);
+	return rms;
+}
+
+/* the checkpoint index of a translated file, built on first use, or NULL */
+struct ods5_rms *ods5_rms_index(struct inode *inode)
+{
+	struct ods5_sb_info *sb_info;
+	struct ods5_fh_info *fh_info;
+	struct ods5_rms *rms;
+
+	fh_info = inode->i_private;
+	sb_info = get_sb_info(inode->i_sb);
+	rms = READ_ONCE(fh_info->rms);
+	if (rms) {
+		ods5_count(sb_info, ODS5_ST_RMS_HIT, 1);
+		return rms;
+	}
+	switch (ods5_rms_translated(inode)) {
+	    case ODS5_XLATE_RECORDS:
+		rms = rms_build(inode);
+		break;
+	    case ODS5_XLATE_CRLF:
+		rms = stream_build(inode);
+		break;
+	    default:
+		/* the size doesn't change */
+		return NULL;
+	}
+	ods5_count(sb_info, ODS5_ST_RMS_BUILD, 1);
+	if (IS_ERR(rms))
+		return rms;
+	/* built twice in parallel: keep the first one */
+	if (cmpxchg(&fh_info->rms, NULL, rms) != NULL) {
+		kvfree(rms);
+		return fh_info->rms;
+	}
+	i_size_write(inode, rms->size);
+	ods5_cache_charge(inode, struct_size(rms, ck, rms->nck));
+	return rms;
+}
+
+void ods5_rms_free(struct ods5_fh_info *fh_info)
+{
+	kvfree(fh_info->rms);
+	fh_info->rms = NULL;
+}
+
+/* copy n times c, return what was copied */
+static size_t emit_chars(char c, vms_long n, struct iov_iter *to)
+{
+	char buf[32];
+	size_t copied, m, k;
+
+	memset(buf, c, sizeof buf);
+	for (copied = 0; copied < n; copied += k) {
+		m = n - copied;
+		if (m > sizeof buf)
+			m = sizeof buf;
+		k = copy_to_iter(buf, m, to);
+		if (k < m)
+			return copied + k;
+	}
+	return copied;
+}
+
+/* copy the translated record, from skip on; returns what was copied */
+static ssize_t rms_emit(struct rms_reader *rr, struct rms_rec *rec,
+			vms_long skip, struct iov_iter *to)
+{
+	vms_long n, avail, want;
+	size_t copied, k;
+	loff_t off;
+	char *p;
+
+	copied = 0;
+	if (skip < rec->pre_n) {
+		n = rec->pre_n - skip;
+		k = emit_chars(rec->pre_c, n, to);
+		copied += k;
+		if (k < n)
+			return copied;
+		skip = 0;
+	} else
+		skip -= rec->pre_n;
+
+	if (skip < rec->len) {
+		off = rec->data + skip;
+		for (n = rec->len - skip; n; n -= k, off += k) {
+			p = rr_map(rr, off, &avail);
+			if (p == NULL)
+				return copied ? copied : -EIO;
+			want = n < avail ? n : avail;
+			k = copy_to_iter(p, want, to);
+			copied += k;
+			if (k < want)
+				return copied;
+		}
+		skip = 0;
+	} else
+		skip -= rec->len;
+
+	if (skip < rec->post_n)
+		copied += emit_chars(rec->post_c, rec->post_n - skip, to);
+	return copied;
+}
+
+/* the last checkpoint at or before pos */
+static vms_long find_ck(struct ods5_rms *rms, loff_t pos)
+{
+	vms_long lo, hi, mid;
+
+	lo = 0;
+	hi = rms->nck - 1;
+	while (lo < hi) {
+		mid = lo + (hi - lo + 1) / 2;
+		if (rms->ck[mid].out <= pos)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	ods5_debug(2, "pos: %Ld, checkpoint %d, out: %Ld, in: %Ld\n",
+		   pos, lo, rms->ck[lo].out, rms->ck[lo].in);
+	return lo;
+}
+
+static ssize_t records_read_iter(struct kiocb *iocb, struct iov_iter *to,
+				 struct inode *inode, struct ods5_rms *rms)
+{
+	struct rms_reader rr;
+	struct rms_rec rec;
+	loff_t pos, out, off, reclen;
+	vms_long k;
+	ssize_t xbytes, n;
+	int ret;
+
+	pos = iocb->ki_pos;
+	if (pos >= rms->size || rms->nck == 0)
+		return 0;
+	k = find_ck(rms, pos);
+	out = rms->ck[k].out;
+	off = rms->ck[k].in;
+
+	rr_init(&rr, inode);
+	xbytes = 0;
+	while (iov_iter_count(to) && out < rms->size) {
+		ret = rms_next(&rr, &off, &rec);
+		if (ret <= 0) {
+			if (ret < 0 && xbytes == 0)
+				xbytes = ret;
+			break;
+		}
+		reclen = rms_outlen(&rec);
+		if (out + reclen <= pos) {
+			out += reclen;
+			continue;
+		}
+		n = rms_emit(&rr, &rec, pos - out, to);
+		if (n < 0) {
+			if (xbytes == 0)
+				xbytes = n;
+			break;
+		}
+		xbytes += n;
+		if (n < reclen - (pos - out)) {
+			if (xbytes == 0)
+				xbytes = -EFAULT;
+			break;
+		}
+		pos += n;
+		out += reclen;
+	}
+	rr_done(&rr);
+	if (xbytes > 0)
+		iocb->ki_pos += xbytes;
+	return xbytes;
+}
+
+/* CR to LF or CRLF to LF, from a checkpoint or, for CR, directly at pos */
+static ssize_t stream_read_iter(struct kiocb *iocb, struct iov_iter *to,
+				struct inode *inode, struct ods5_rms *rms,
+				int crlf)
+{
+	struct rms_reader rr;
+	loff_t pos, out, off, size;
+	vms_long k, n;
+	size_t m, s, c;
+	ssize_t xbytes;
+	int next_lf;
+	char *buf, *p;
+
+	rr_init(&rr, inode);
+	pos = iocb->ki_pos;
+	size = rms ? rms->size : rr.rawsize;
+	if (pos >= size)
+		return 0;
+	if (rms) {
+		if (rms->nck == 0)
+			return 0;
+		k = find_ck(rms, pos);
+		out = rms->ck[k].out;
+		off = rms->ck[k].in;
+	} else
+		out = off = pos;
+	buf = kmalloc(ODS5_BLOCK_SIZE, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	xbytes = 0;
+	while (iov_iter_count(to) && off < rr.rawsize) {
+		p = stream_map(&rr, off, &n, crlf, &next_lf);
+		if (p == NULL) {
+			if (xbytes == 0)
+				xbytes = -EIO;
+			break;
+		}
+		m = xlate_chunk(p, n, buf, crlf, next_lf);
+		off += n;
+		if (out + m <= pos) {
+			out += m;
+			continue;
+		}
+		s = pos - out;
+		c = copy_to_iter(buf + s, m - s, to);
+		xbytes += c;
+		if (c < m - s) {
+			if (xbytes == 0)
+				xbytes = -EFAULT;
+			break;
+		}
+		pos += c;
+		out += m;
+	}
+	rr_done(&rr);
+	kfree(buf);
+	if (xbytes > 0)
+		iocb->ki_pos += xbytes;
+	return xbytes;
+}
+
+ssize_t ods5_rms_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct inode *inode;
+	struct ods5_rms *rms;
+	int xlate;
+
+	inode = file_inode(iocb->ki_filp);
+	/* the translation is done with blocking reads */
+	if (iocb->ki_flags & IOCB_NOWAIT)
+		return -EAGAIN;
+	if (iov_iter_count(to) == 0)
+		return 0;
+	rms = ods5_rms_index(inode);
+	if (IS_ERR(rms))
+		return PTR_ERR(rms);
+	xlate = ods5_rms_translated(inode);
+	if (xlate == ODS5_XLATE_RECORDS)
+		return records_read_iter(iocb, to, inode, rms);
+	return stream_read_iter(iocb, to, inode, rms, xlate == ODS5_XLATE_CRLF);
+}
+
+/* the prologue of a relative file: the first data vbn */
+#define PLG_DVBN	104
+/* the control byte of a relative cell */
+#define IRC_DELETED	0x04
+#define IRC_EXISTS	0x08
+
+/* the next record to return */
+typedef struct rec_iter {
+	struct rms_reader rr;
+	int cells;		/* fixed length records or relative cells */
+	int relative;
+	loff_t base;		/* raw offset of the first cell */
+	vms_long cell;		/* cell size */
+	vms_long per;		/* cells per block or bucket, 0: no boundaries */
+	vms_long bucket;	/* block or bucket size in bytes */
+	vms_long rsize;		/* record size of fixed length records */
+	vms_long maxlen;	/* longest data of a record, 0: any */
+	loff_t off;		/* variable: raw offset of the next record */
+	loff_t k;		/* index of the next record */
+} _REC_ITER;
+
+static loff_t cell_pos(struct rec_iter *ri, loff_t k)
+{
+	u64 q;
+	vms_long r;
+
+	if (ri->per == 0)
+		return ri->base + k * ri->cell;
+	q = k;
+	r = do_div(q, ri->per);
+	return ri->base + q * ri->bucket + r * ri->cell;
+}
+
+/* the index of the first cell at or after the raw offset pos */
+static loff_t cell_index(struct rec_iter *ri, loff_t pos)
+{
+	loff_t blk;
+	vms_long r, i;
+
+	if (pos <= ri->base)
+		return 0;
+	pos -= ri->base;
+	if (ri->per == 0)
+		return div_u64(pos + ri->cell - 1, ri->cell);
+	blk = div_u64(pos, ri->bucket);
+	r = pos - blk * ri->bucket;
+	i = DIV_ROUND_UP(r, ri->cell);
+	if (i > ri->per)
+		i = ri->per;
+	return blk * ri->per + i;
+}
+
+/* set up the layout of the file */
+static int rec_init(struct rec_iter *ri, struct inode *inode)
+{
+	struct ods5_fat *fat;
+	vms_byte plg[2];
+	vms_long dvbn, fsz;
+	int ret;
+
+	rr_init(&ri->rr, inode);
+	fat = ri->rr.fat;
+	ri->cells = 0;
+	ri->relative = 0;
+	ri->base = 0;
+	ri->per = 0;
+	ri->bucket = ODS5_BLOCK_SIZE;
+	ri->rsize = fat->rsize;
+	ri->maxlen = 0;
+	ri->off = 0;
+	ri->k = 0;
+	/* VFC records include the fixed control area */
+	fsz = 0;
+	if (fat->rtype.rtype == FAT_VFC)
+		fsz = fat->vfcsize ? fat->vfcsize : 2;
+	switch (fat->rtype.fileorg) {
+	    case FAT_SEQUENTIAL:
+		switch (fat->rtype.rtype) {
+		    case FAT_VARIABLE:
+		    case FAT_VFC:
+			if (fat->rsize)
+				ri->maxlen = fat->rsize + fsz;
+			return 0;
+		    case FAT_FIXED:
+			if (fat->rsize == 0)
+				return -EIO;
+			ri->cells = 1;
+			/* records start at a word boundary */
+			ri->cell = fat->rsize + (fat->rsize & 1);
+			if (fat->rattrib.nospan && ri->cell <= ODS5_BLOCK_SIZE)
+				ri->per = ODS5_BLOCK_SIZE / ri->cell;
+			return 0;
+		}
+		return -EOPNOTSUPP;
+	    case FAT_RELATIVE:
+		if (fat->rsize == 0)
+			return -EIO;
+		ret = rr_get(&ri->rr, PLG_DVBN, plg, 2);
+		if (ret)
+			return ret;
+		dvbn = get_unaligned_le16(plg);
+		if (dvbn == 0)
+			dvbn = 2;
+		ri->cells = 1;
+		ri->relative = 1;
+		ri->base = (loff_t)(dvbn - 1) * ODS5_BLOCK_SIZE;
+		ri->cell = 1 + fat->rsize;
+		if (fat->rtype.rtype != FAT_FIXED) {
+			ri->cell += 2 + fsz;
+			ri->maxlen = ri->cell - 3;
+		}
+		ri->bucket = (fat->bktsize ? fat->bktsize : 1) * ODS5_BLOCK_SIZE;
+		if (ri->cell > ri->bucket)
+			return -EIO;
+		ri->per = ri->bucket / ri->cell;
+		ods5_debug(2, "dvbn: %d, cell: %d, per bucket: %d\n",
+			   dvbn, ri->cell, ri->per);
+		return 0;
+	}
+	return -EOPNOTSUPP;
+}
+
+/*
+ * The next record: its position, raw offset of the data and length.
+ * Returns 1 for a record, 0 at EOF.
+ */
+static int rec_next(struct rec_iter *ri, loff_t *pos, loff_t *data,
+		    vms_long *len)
+{
+	vms_byte ctl[3];
+	int ret;
+
+	if (!ri->cells) {
+		ret = rms_rcw(&ri->rr, &ri->off, data, len);
+		if (ret <= 0)
+			return ret;
+		*pos = *data - 2;
+		ri->k++;
+		goto check;
+	}
+	for (;;) {
+		*pos = cell_pos(ri, ri->k);
+		if (*pos + (ri->relative ? ri->cell : ri->rsize) > ri->rr.rawsize)
+			return 0;
+		ri->k++;
+		if (!ri->relative) {
+			*data = *pos;
+			*len = ri->rsize;
+			return 1;
+		}
+		ret = rr_get(&ri->rr, *pos, ctl, 1);
+		if (ret)
+			return ret;
+		if ((ctl[0] & (IRC_EXISTS | IRC_DELETED)) == IRC_EXISTS)
+			break;
+		/* an empty or deleted cell */
+		if ((ri->k & 1023) == 0) {
+			if (fatal_signal_pending(current))
+				return -EINTR;
+			cond_resched();
+		}
+	}
+	*data = *pos + 1;
+	*len = ri->rsize;
+	if (ri->rr.fat->rtype.rtype == FAT_FIXED)
+		return 1;
+	ret = rr_get(&ri->rr, *pos + 1, ctl + 1, 2);
+	if (ret)
+		return ret;
+	*data += 2;
+	*len = ctl[1] + (ctl[2] << 8);
+check:
+	if (ri->maxlen && *len > ri->maxlen) {
+		ods5_debug(1, "record at %Ld, length %d > %d\n",
+			   *pos, *len, ri->maxlen);
+		return -EIO;
+	}
+	return 1;
+}
+
+/* copy len raw bytes at off to the user */
+static int rec_copy(struct rms_reader *rr, loff_t off, vms_long len,
+		    char __user *dst)
+{
+	vms_long n;
+	char *p;
+
+	while (len) {
+		p = rr_map(rr, off, &n);
+		if (p == NULL)
+			return -EIO;
+		if (n > len)
+			n = len;
+		if (copy_to_user(dst, p, n))
+			return -EFAULT;
+		dst += n;
+		off += n;
+		len -= n;
+	}
+	return 0;
+}
+
+long ods5_ioc_records(struct file *filp, unsigned long arg)
+{
+	struct inode *inode;
+	struct ods5_records req;
+	struct ods5_recdesc desc;
+	struct ods5_recdesc __user *udesc;
+	struct rec_iter ri;
+	loff_t pos, data, off, k, skip;
+	vms_long len, used, n;
+	int recno;
+	long ret;
+
+	inode = file_inode(filp);
+	if (!S_ISREG(inode->i_mode))
+		return -EINVAL;
+	if (copy_from_user(&req, (void __user *)arg, sizeof req))
+		return -EFAULT;
+	if ((req.flags & ~ODS5_RECORDS_RECNO) || req.spare)
+		return -EINVAL;
+	if (req.count > ODS5_RECORDS_MAX)
+		req.count = ODS5_RECORDS_MAX;
+	recno = req.flags & ODS5_RECORDS_RECNO;
+
+	ret = rec_init(&ri, inode);
+	if (ret)
+		goto out;
+	/*
+	 * A cursor beyond the end is EOF, also one so large that its raw
+	 * offset would wrap; record number cells + 1 is returned at EOF.
+	 */
+	if (recno ? ri.cells && req.cursor > cell_index(&ri, ri.rr.rawsize) + 1
+		  : !ri.relative && req.cursor > ri.rr.rawsize) {
+		req.count = 0;
+		req.size = 0;
+		if (copy_to_user((void __user *)arg, &req, sizeof req))
+			ret = -EFAULT;
+		goto out;
+	}
+	/* position at the first record */
+	if (ri.cells) {
+		if (recno)
+			ri.k = req.cursor ? req.cursor - 1 : 0;
+		else if (ri.relative)
+			ret = -EINVAL;
+		else
+			ri.k = cell_index(&ri, req.cursor);
+	} else if (recno) {
+		for (skip = 1; skip < req.cursor; skip++) {
+			ret = rms_rcw(&ri.rr, &ri.off, &data, &len);
+			if (ret <= 0)
+				break;
+			ri.k++;
+			if ((skip & 1023) == 0) {
+				if (fatal_signal_pending(current)) {
+					ret = -EINTR;
+					break;
+				}
+				cond_resched();
+			}
+		}
+		if (ret > 0)
+			ret = 0;
+	} else
+		ri.off = req.cursor;
+	if (ret)
+		goto out;
+	ods5_debug(2, "cursor: %Ld, recno: %d, count: %d, size: %d\n",
+		   req.cursor, recno, req.count, req.size);
+
+	udesc = (struct ods5_recdesc __user *)(unsigned long)req.descs;
+	used = 0;
+	for (n = 0; n < req.count; n++) {
+		off = ri.off;
+		k = ri.k;
+		ret = rec_next(&ri, &pos, &data, &len);
+		if (ret <= 0)
+			break;
+		ret = 0;
+		if (len > req.size - used) {
+			/* leave it for the next call */
+			ri.off = off;
+			ri.k = k;
+			if (n == 0) {
+				used = len;
+				ret = -ERANGE;
+			}
+			break;
+		}
+		ret = rec_copy(&ri.rr, data, len,
+			       (char __user *)(unsigned long)req.buffer + used);
+		if (ret)
+			break;
+		desc.pos = recno ? ri.k : pos;
+		desc.offset = used;
+		desc.length = len;
+		if (copy_to_user(&udesc[n], &desc, sizeof desc)) {
+			ret = -EFAULT;
+			break;
+		}
+		used += len;
+	}
+	/* the records so far are returned, the error comes with the next call */
+	if (n && ret != -EFAULT)
+		ret = 0;
+	if (ret && ret != -ERANGE)
+		goto out;
+
+	req.count = n;
+	req.size = used;
+	if (recno)
+		req.cursor = ri.k + 1;
+	else if (ri.cells)
+		req.cursor = cell_pos(&ri, ri.k);
+	else
+		req.cursor = ri.off;
+	if (copy_to_user((void __user *)arg, &req, sizeof req))
+		ret = -EFAULT;
+out:
+	rr_done(&ri.rr);
+	return ret;
+}
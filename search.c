@@ -0,0 +1,859 @@
+/*
+ * linux/fs/ods5/search.c
+ *
+ * This file is part of the OpenVMS ODS5 file system for Linux.
+ * Copyright (C) 2017 Hartmut Becker.
+ *
+ * The OpenVMS ODS5 file system for Linux is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The OpenVMS ODS5 file system for Linux is distributed in the hope that it
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/capability.h>
+#include <linux/ctype.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/nls.h>
+#include <linux/sched/signal.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+
+#include "./ods5_fs.h"
+#include "./ods5.h"
+
+/*
+ * VMS wildcard search in a directory.
+ * The records of a directory are sorted case-blind, that is what
+ * ods5_find_match relies on to stop early. Here it is used twice: the
+ * directory blocks are binary searched for the first block which may have
+ * a name with the literal prefix of the pattern (the characters up to the
+ * first wildcard), and the scan stops at the first name beyond the prefix.
+ * So a search for LOG_2024*.DAT reads a few blocks to find the start and
+ * then just the blocks with LOG_2024 names.
+ * UCS-2 names are not searched: they don't sort with the ISL-1 names.
+ */
+
+/* which versions match */
+#define VER_ALL		0
+#define VER_EXACT	1
+#define VER_RELATIVE	2	/* by position, 0 is the latest */
+
+typedef struct search_spec {
+	unsigned char pat[ODS5_FILENAME_LEN + 3];	/* upcased */
+	int pl;
+	int prefl;		/* literal prefix of pat */
+	int vmode;
+	vms_long vnum;
+} _SEARCH_SPEC;
+
+typedef struct search_pos {
+	vms_long cursor;
+	vms_word verskip;
+	vms_word verindex;
+} _SEARCH_POS;
+
+/* called for each match, return 1 to stop before this entry */
+typedef int (*search_fn)(void *arg, struct ods5_dir *dir,
+			 struct ods5_dirent *dirval, vms_long idx);
+
+/* convert a name as the mount shows it to ISL-1, at most ODS5_FILENAME_LEN */
+static int name_to_isl(struct ods5_sb_info *sb_info, const char *p, int nl,
+		       unsigned char *isl)
+{
+	int i, l, cl;
+	unicode_t u;
+
+	for (i = l = 0; i < nl; i += cl) {
+		u = (unsigned char)p[i];
+		cl = 1;
+		if (sb_info->utf8) {
+			cl = utf8_to_utf32((const u8 *)&p[i], nl - i, &u);
+			if (cl < 0 || u > 0xff)
+				return -EINVAL;
+		}
+		if (l >= ODS5_FILENAME_LEN)
+			return -EINVAL;
+		isl[l++] = u;
+	}
+	return l;
+}
+
+/*
+ * Parse name;version into ss. Without wild, there must be no wildcards,
+ * the default type is empty and the default version the latest.
+ */
+static int parse_pattern(struct ods5_sb_info *sb_info, struct search_spec *ss,
+			 const char *p, int pl, int wild)
+{
+	const char *semi, *v;
+	vms_long num;
+	int neg, nl, i, l;
+
+	ss->vmode = VER_ALL;
+	ss->vnum = 0;
+	semi = strrchr(p, ';');
+	nl = semi ? semi - p : pl;
+	if (semi && semi[1] && strcmp(semi + 1, "*") != 0) {
+		v = semi + 1;
+		neg = *v == '-';
+		if (neg)
+			v++;
+		if (*v == 0)
+			return -EINVAL;
+		for (num = 0; *v; v++) {
+			if (*v < '0' || *v > '9' || num > 32767)
+				return -EINVAL;
+			num = num * 10 + *v - '0';
+		}
+		if (num > 32767)
+			return -EINVAL;
+		ss->vnum = num;
+		if (neg || num == 0)
+			ss->vmode = VER_RELATIVE;
+		else
+			ss->vmode = VER_EXACT;
+	}
+
+	/* the name, as ISL-1 and upcased */
+	l = name_to_isl(sb_info, p, nl, ss->pat);
+	if (l < 0)
+		return l;
+	for (i = 0; i < l; i++)
+		ss->pat[i] = toupper(ss->pat[i]);
+	if (!wild) {
+		if (l == 0 || memchr(ss->pat, '*', l) || memchr(ss->pat, '%', l))
+			return -EINVAL;
+		if (!memchr(ss->pat, '.', l))
+			ss->pat[l++] = '.';
+		if (ss->vmode == VER_ALL)
+			ss->vmode = VER_RELATIVE;
+	}
+	if (l == 0)
+		ss->pat[l++] = '*';
+	if (!memchr(ss->pat, '.', l)) {
+		ss->pat[l++] = '.';
+		ss->pat[l++] = '*';
+	}
+	ss->pl = l;
+	for (ss->prefl = 0; ss->prefl < l; ss->prefl++)
+		if (ss->pat[ss->prefl] == '*' || ss->pat[ss->prefl] == '%')
+			break;
+	ods5_debug(2, "pattern: %.*s, prefix: %d, vmode: %d, vnum: %d\n",
+		   ss->pl, ss->pat, ss->prefl, ss->vmode, ss->vnum);
+	return 0;
+}
+
+/* case-blind match of name with the upcased pattern */
+static int wild_match(const unsigned char *pat, int pl,
+		      const unsigned char *name, int nl)
+{
+	int p, n, star, mark;
+
+	p = n = mark = 0;
+	star = -1;
+	while (n < nl) {
+		if (p < pl && (pat[p] == '%' || pat[p] == toupper(name[n]))) {
+			p++;
+			n++;
+		} else if (p < pl && pat[p] == '*') {
+			star = p++;
+			mark = n;
+		} else if (star >= 0) {
+			p = star + 1;
+			n = ++mark;
+		} else
+			return 0;
+	}
+	while (p < pl && pat[p] == '*')
+		p++;
+	return p == pl;
+}
+
+/* case-blind compare of a name with the prefix, in directory order */
+static int prefix_cmp(struct ods5_dir *dir, const unsigned char *prefix,
+		      int prefl)
+{
+	int i, minl, r;
+
+	minl = dir->namecount < prefl ? dir->namecount : prefl;
+	for (i = 0; i < minl; i++) {
+		r = toupper(dir->name[i]) - prefix[i];
+		if (r)
+			return r;
+	}
+	return dir->namecount < prefl ? -1 : 0;
+}
+
+static char *read_dir_block(struct inode *inode, vms_long vbn,
+			    struct ods5_mblk *mb)
+{
+	vms_long lbn, unused;
+
+	if (!mapvbn(inode->i_sb, inode, vbn, &lbn, &unused))
+		return NULL;
+	return ods5_mread(inode->i_sb, lbn, mb);
+}
+
+/*
+ * Set the end of the record at fnoff and the offset of its version
+ * entries. A record which doesn't fit into the block, with its name, ends
+ * the scan of the block.
+ */
+static int dir_record(struct ods5_dir *dir, vms_long fnoff, vms_long *recend,
+		      vms_long *vfoff)
+{
+	*recend = fnoff + dir->size + sizeof dir->size;
+	*vfoff = fnoff + offsetof(struct ods5_dir, name)
+		 + ((dir->namecount + 1) & ~1);
+	return *recend <= ODS5_BLOCK_SIZE && *vfoff <= *recend;
+}
+
+/* a cursor must be one handed out: the start of a record of the block */
+static int check_cursor(struct inode *inode, vms_long vbn, vms_long off)
+{
+	struct ods5_dir *dir;
+	struct ods5_mblk mb;
+	char *block;
+	vms_long fnoff, recend, vfoff;
+	int ret;
+
+	if (vbn > inode->i_size >> ODS5_BLOCK_SHIFT)
+		return -EINVAL;
+	block = read_dir_block(inode, vbn, &mb);
+	if (block == NULL)
+		return -EIO;
+	ret = -EINVAL;
+	for (fnoff = 0; fnoff <= off && fnoff <= ODS5_BLOCK_SIZE - sizeof *dir;
+	     fnoff = recend) {
+		dir = (struct ods5_dir *)(block + fnoff);
+		if (dir->size == NO_MORE_RECORDS
+		    || !dir_record(dir, fnoff, &recend, &vfoff))
+			break;
+		if (fnoff == off) {
+			ret = 0;
+			break;
+		}
+	}
+	ods5_mrelease(&mb);
+	return ret;
+}
+
+/*
+ * Is the first ISL-1 name of the block below the prefix? Also tell whether
+ * the first record continues the versions of the previous block.
+ */
+static int first_below(struct inode *inode, vms_long vbn,
+		       struct search_spec *ss, int *prevrec)
+{
+	struct ods5_dir *dir;
+	struct ods5_mblk mb;
+	char *block;
+	vms_long fnoff, recend, vfoff;
+	int below;
+
+	block = read_dir_block(inode, vbn, &mb);
+	if (block == NULL)
+		return -EIO;
+	below = 0;
+	*prevrec = 0;
+	for (fnoff = 0; fnoff <= ODS5_BLOCK_SIZE - sizeof *dir; fnoff = recend) {
+		dir = (struct ods5_dir *)(block + fnoff);
+		if (dir->size == NO_MORE_RECORDS
+		    || !dir_record(dir, fnoff, &recend, &vfoff))
+			break;
+		if (fnoff == 0)
+			*prevrec = dir->flags.prevrec;
+		if (dir->flags.type != DIR_FID || dir->flags.nametype == DIR_UCS2)
+			continue;
+		below = prefix_cmp(dir, ss->pat, ss->prefl) < 0;
+		break;
+	}
+	ods5_mrelease(&mb);
+	return below;
+}
+
+/* binary search the block to start with */
+static long find_start(struct inode *inode, vms_long nblocks,
+		       struct search_spec *ss)
+{
+	vms_long lo, hi, mid, start;
+	int below, prevrec;
+
+	start = 1;
+	if (ss->prefl == 0)
+		return start;
+	lo = 1;
+	hi = nblocks;
+	while (lo <= hi) {
+		mid = lo + (hi - lo) / 2;
+		below = first_below(inode, mid, ss, &prevrec);
+		if (below < 0)
+			return below;
+		if (below) {
+			start = mid;
+			lo = mid + 1;
+		} else
+			hi = mid - 1;
+	}
+	/* start with the first part of the versions of a name */
+	while (start > 1) {
+		below = first_below(inode, start, ss, &prevrec);
+		if (below < 0)
+			return below;
+		if (!prevrec)
+			break;
+		start--;
+	}
+	ods5_debug(2, "start vbn: %d of %d\n", start, nblocks);
+	return start;
+}
+
+static int version_match(struct search_spec *ss, vms_word version,
+			 vms_long idx)
+{
+	switch (ss->vmode) {
+	    case VER_EXACT:
+		return version == ss->vnum;
+	    case VER_RELATIVE:
+		return idx == ss->vnum;
+	}
+	return 1;
+}
+
+/*
+ * Scan the directory from the position sp for entries matching ss, call fn
+ * for each of them. The versions of a name can be split into several
+ * records, idx counts through all of them.
+ */
+static int search_dir(struct inode *inode, struct search_spec *ss,
+		      struct search_pos *sp, search_fn fn, void *arg)
+{
+	struct ods5_dir *dir;
+	struct ods5_dirent *dirval;
+	struct ods5_mblk mb;
+	char *block;
+	unsigned char prevname[256];
+	vms_long nblocks, vbn;
+	vms_long fnoff, vfoff, recend;
+	vms_long nent, vbase, prevcount, skip, j;
+	int prevl, resume, r;
+	long start;
+
+	if (sp->cursor == ODS5_SEARCH_END)
+		return 0;
+	nblocks = inode->i_size >> ODS5_BLOCK_SHIFT;
+	if (sp->cursor == 0) {
+		start = find_start(inode, nblocks, ss);
+		if (start < 0)
+			return start;
+		vbn = start;
+		fnoff = 0;
+		skip = 0;
+		resume = 0;
+	} else {
+		vbn = ((sp->cursor - 1) >> ODS5_BLOCK_SHIFT) + 1;
+		fnoff = (sp->cursor - 1) & (ODS5_BLOCK_SIZE - 1);
+		r = check_cursor(inode, vbn, fnoff);
+		if (r)
+			return r;
+		skip = sp->verskip;
+		resume = 1;
+	}
+
+	vbase = prevcount = 0;
+	prevl = -1;
+	for (; vbn <= nblocks; vbn++, fnoff = 0) {
+		if (fatal_signal_pending(current))
+			return -EINTR;
+		cond_resched();
+		block = read_dir_block(inode, vbn, &mb);
+		if (block == NULL)
+			return -EIO;
+		for (; fnoff <= ODS5_BLOCK_SIZE - sizeof *dir; fnoff = recend) {
+			dir = (struct ods5_dir *)(block + fnoff);
+			if (dir->size == NO_MORE_RECORDS
+			    || !dir_record(dir, fnoff, &recend, &vfoff))
+				break;
+			if (dir->flags.type != DIR_FID
+			    || dir->flags.nametype == DIR_UCS2) {
+				prevl = -1;
+				continue;
+			}
+			/* beyond the prefix, no more matches */
+			if (ss->prefl && prefix_cmp(dir, ss->pat, ss->prefl) > 0) {
+				ods5_mrelease(&mb);
+				sp->cursor = ODS5_SEARCH_END;
+				return 0;
+			}
+			nent = (recend - vfoff) / sizeof *dirval;
+			if (resume) {
+				vbase = sp->verindex;
+				resume = 0;
+			} else if (prevl == dir->namecount
+				   && memcmp(prevname, dir->name, prevl) == 0)
+				vbase += prevcount;
+			else
+				vbase = 0;
+			prevl = dir->namecount;
+			memcpy(prevname, dir->name, prevl);
+			prevcount = nent;
+
+			if (!wild_match(ss->pat, ss->pl, dir->name, dir->namecount)) {
+				skip = 0;
+				continue;
+			}
+			dirval = (struct ods5_dirent *)(block + vfoff);
+			for (j = skip; j < nent; j++) {
+				if (!version_match(ss, dirval[j].version, vbase + j))
+					continue;
+				r = fn(arg, dir, &dirval[j], vbase + j);
+				if (r == 0)
+					continue;
+				ods5_mrelease(&mb);
+				if (r < 0)
+					return r;
+				sp->cursor = (vbn - 1) * ODS5_BLOCK_SIZE + fnoff + 1;
+				sp->verskip = j;
+				sp->verindex = vbase;
+				return 0;
+			}
+			skip = 0;
+		}
+		ods5_mrelease(&mb);
+	}
+	sp->cursor = ODS5_SEARCH_END;
+	return 0;
+}
+
+/*
+ * Call fn with the FID of each entry of the directory, also of the entries
+ * with UCS-2 names: without a pattern, the sort order doesn't matter.
+ */
+int ods5_for_each_entry(struct inode *dir,
+			int (*fn)(void *arg, struct ods5_fid *fid), void *arg)
+{
+	struct ods5_dir *rec;
+	struct ods5_dirent *dirval;
+	struct ods5_mblk mb;
+	char *block;
+	vms_long nblocks, vbn;
+	vms_long fnoff, vfoff, recend, nent, j;
+	int ret;
+
+	nblocks = dir->i_size >> ODS5_BLOCK_SHIFT;
+	for (vbn = 1; vbn <= nblocks; vbn++) {
+		if (fatal_signal_pending(current))
+			return -EINTR;
+		cond_resched();
+		block = read_dir_block(dir, vbn, &mb);
+		if (block == NULL)
+			return -EIO;
+		for (fnoff = 0; fnoff <= ODS5_BLOCK_SIZE - sizeof *rec;
+		     fnoff = recend) {
+			rec = (struct ods5_dir *)(block + fnoff);
+			if (rec->size == NO_MORE_RECORDS
+			    || !dir_record(rec, fnoff, &recend, &vfoff))
+				break;
+			if (rec->flags.type != DIR_FID)
+				continue;
+			nent = (recend - vfoff) / sizeof *dirval;
+			dirval = (struct ods5_dirent *)(block + vfoff);
+			for (j = 0; j < nent; j++) {
+				ret = fn(arg, &dirval[j].fid);
+				if (ret < 0) {
+					ods5_mrelease(&mb);
+					return ret;
+				}
+			}
+		}
+		ods5_mrelease(&mb);
+	}
+	return 0;
+}
+
+typedef struct search_out {
+	struct ods5_sb_info *sb_info;
+	struct ods5_match __user *ubuf;
+	struct ods5_match *m;
+	vms_long count;
+	vms_long out;
+} _SEARCH_OUT;
+
+static int emit_match(void *arg, struct ods5_dir *dir,
+		      struct ods5_dirent *dirval, vms_long idx)
+{
+	struct search_out *so = arg;
+	struct ods5_match *m = so->m;
+
+	if (so->out >= so->count)
+		return 1;
+	memset(m, 0, sizeof *m);
+	m->fid = dirval->fid;
+	m->version = dirval->version;
+	m->namelen = ods5_dir_name(so->sb_info, dir, dirval->version,
+				   m->name, sizeof m->name);
+	if (copy_to_user(&so->ubuf[so->out], m, sizeof *m))
+		return -EFAULT;
+	so->out++;
+	return 0;
+}
+
+long ods5_ioc_search(struct file *filp, unsigned long arg)
+{
+	struct inode *inode;
+	struct ods5_search req;
+	struct search_spec *ss;
+	struct search_pos sp;
+	struct search_out so;
+	char *pattern;
+	long ret;
+
+	inode = filp->f_path.dentry->d_inode;
+	if (!S_ISDIR(inode->i_mode))
+		return -ENOTDIR;
+	if (copy_from_user(&req, (void __user *)arg, sizeof req))
+		return -EFAULT;
+	if (req.patlen == 0 || req.patlen > ODS5_FN_STRING_SIZE*3)
+		return -EINVAL;
+
+	ret = -ENOMEM;
+	pattern = kmalloc(req.patlen + 1, GFP_KERNEL);
+	ss = kmalloc(sizeof *ss, GFP_KERNEL);
+	so.m = kmalloc(sizeof *so.m, GFP_KERNEL);
+	if (!pattern || !ss || !so.m)
+		goto out;
+	ret = -EFAULT;
+	if (copy_from_user(pattern, (void __user *)(unsigned long)req.pattern,
+			   req.patlen))
+		goto out;
+	pattern[req.patlen] = 0;
+	ret = -EINVAL;
+	if (strlen(pattern) != req.patlen)
+		goto out;
+	so.sb_info = get_sb_info(inode->i_sb);
+	ret = parse_pattern(so.sb_info, ss, pattern, req.patlen, 1);
+	if (ret)
+		goto out;
+
+	so.ubuf = (struct ods5_match __user *)(unsigned long)req.buffer;
+	so.count = req.count;
+	so.out = 0;
+	sp.cursor = req.cursor;
+	sp.verskip = req.verskip;
+	sp.verindex = req.verindex;
+	ret = search_dir(inode, ss, &sp, emit_match, &so);
+	if (ret)
+		goto out;
+	req.count = so.out;
+	req.cursor = sp.cursor;
+	req.verskip = sp.verskip;
+	req.verindex = sp.verindex;
+	if (copy_to_user((void __user *)arg, &req, sizeof req))
+		ret = -EFAULT;
+out:
+	kfree(so.m);
+	kfree(ss);
+	kfree(pattern);
+	return ret;
+}
+
+typedef struct versions_out {
+	unsigned char name[ODS5_FILENAME_LEN];
+	int nl;
+	struct ods5_dirent __user *ubuf;
+	vms_long count;
+	vms_long out;
+} _VERSIONS_OUT;
+
+/* the search is case-blind, only the exact name counts */
+static int emit_version(void *arg, struct ods5_dir *dir,
+			struct ods5_dirent *dirval, vms_long idx)
+{
+	struct versions_out *vo = arg;
+
+	if (dir->namecount != vo->nl || memcmp(dir->name, vo->name, vo->nl))
+		return 0;
+	if (vo->out < vo->count
+	    && copy_to_user(&vo->ubuf[vo->out], dirval, sizeof *dirval))
+		return -EFAULT;
+	vo->out++;
+	return 0;
+}
+
+/*
+ * All versions of a name, like ods5_find_match but without a version: the
+ * record is located with the case-blind search for the name as the literal
+ * prefix, its version entries and those of continuation records are
+ * returned as they are in the directory, in descending order.
+ */
+long ods5_ioc_versions(struct file *filp, unsigned long arg)
+{
+	struct inode *inode;
+	struct ods5_versions req;
+	struct search_spec *ss;
+	struct search_pos sp;
+	struct versions_out *vo;
+	char *name;
+	int i;
+	long ret;
+
+	inode = filp->f_path.dentry->d_inode;
+	if (!S_ISDIR(inode->i_mode))
+		return -ENOTDIR;
+	if (copy_from_user(&req, (void __user *)arg, sizeof req))
+		return -EFAULT;
+	if (req.namelen == 0 || req.namelen > ODS5_FN_STRING_SIZE*3)
+		return -EINVAL;
+
+	ret = -ENOMEM;
+	name = kmalloc(req.namelen, GFP_KERNEL);
+	ss = kmalloc(sizeof *ss, GFP_KERNEL);
+	vo = kmalloc(sizeof *vo, GFP_KERNEL);
+	if (!name || !ss || !vo)
+		goto out;
+	ret = -EFAULT;
+	if (copy_from_user(name, (void __user *)(unsigned long)req.name,
+			   req.namelen))
+		goto out;
+	ret = name_to_isl(get_sb_info(inode->i_sb), name, req.namelen, vo->name);
+	if (ret < 0)
+		goto out;
+	vo->nl = ret;
+	ret = -EINVAL;
+	for (i = 0; i < vo->nl; i++) {
+		if (vo->name[i] == '*' || vo->name[i] == '%'
+		    || vo->name[i] == ';' || vo->name[i] == 0)
+			goto out;
+		ss->pat[i] = toupper(vo->name[i]);
+	}
+	ss->pl = ss->prefl = vo->nl;
+	ss->vmode = VER_ALL;
+	ss->vnum = 0;
+
+	vo->ubuf = (struct ods5_dirent __user *)(unsigned long)req.buffer;
+	vo->count = req.count;
+	vo->out = 0;
+	sp.cursor = 0;
+	ret = search_dir(inode, ss, &sp, emit_version, vo);
+	if (ret)
+		goto out;
+	req.count = vo->out;
+	if (copy_to_user((void __user *)arg, &req, sizeof req))
+		ret = -EFAULT;
+out:
+	kfree(vo);
+	kfree(ss);
+	kfree(name);
+	return ret;
+}
+
+/* the first case-blind match is the one */
+static int emit_first(void *arg, struct ods5_dir *dir,
+		      struct ods5_dirent *dirval, vms_long idx)
+{
+	*(struct ods5_fid *)arg = dirval->fid;
+	return 1;
+}
+
+/* look up the entry for ss in dir, on success dir is replaced by its inode */
+static int walk_entry(struct inode **dir, struct search_spec *ss,
+		      struct ods5_fid *fid)
+{
+	struct search_pos sp;
+	struct inode *inode;
+	int ret;
+
+	sp.cursor = 0;
+	ret = search_dir(*dir, ss, &sp, emit_first, fid);
+	if (ret)
+		return ret;
+	if (sp.cursor == ODS5_SEARCH_END)
+		return -ENOENT;
+	inode = ods5_iget((*dir)->i_sb, fid->num + (fid->nmx << 16), fid->seq);
+	if (!inode)
+		return -ENOENT;
+	iput(*dir);
+	*dir = inode;
+	return 0;
+}
+
+static int open_inode(struct file *filp, struct inode *inode, struct file **file)
+{
+	struct dentry *dentry;
+	struct path path;
+	int fd;
+
+	dentry = d_obtain_alias(igrab(inode));
+	if (IS_ERR(dentry))
+		return PTR_ERR(dentry);
+	fd = get_unused_fd_flags(O_CLOEXEC);
+	if (fd < 0) {
+		dput(dentry);
+		return fd;
+	}
+	path.mnt = filp->f_path.mnt;
+	path.dentry = dentry;
+	*file = dentry_open(&path, O_RDONLY | O_LARGEFILE, current_cred());
+	dput(dentry);
+	if (IS_ERR(*file)) {
+		put_unused_fd(fd);
+		return PTR_ERR(*file);
+	}
+	return fd;
+}
+
+/*
+ * Resolve a VMS file specification like [PROJ.SRC.LIB]MODULE.C;7 in one
+ * call. A device and node part up to the last ':' is ignored, the directory
+ * is relative to the MFD of this volume, [000000] is the MFD itself. Each
+ * directory NAME is looked up as NAME.DIR;1, with the same case-blind
+ * search as ODS5_IOC_SEARCH. Without a file name the result is the last
+ * directory.
+ */
+long ods5_ioc_filespec(struct file *filp, unsigned long arg)
+{
+	struct super_block *sb;
+	struct ods5_sb_info *sb_info;
+	struct ods5_filespec req;
+	struct search_spec *ss;
+	struct inode *dir;
+	struct file *file;
+	struct ods5_fid fid;
+	char *spec, *p, *dirend, *comp, *next;
+	char close;
+	int l, i, fd;
+	long ret;
+
+	sb = filp->f_path.dentry->d_sb;
+	sb_info = get_sb_info(sb);
+	if (filp->f_path.dentry != sb->s_root)
+		return -EINVAL;
+	/* directory permissions are not checked on the way */
+	if (!capable(CAP_DAC_READ_SEARCH))
+		return -EPERM;
+	if (copy_from_user(&req, (void __user *)arg, sizeof req))
+		return -EFAULT;
+	if (req.speclen == 0 || req.speclen > PATH_MAX
+	    || (req.flags & ~ODS5_FILESPEC_OPEN))
+		return -EINVAL;
+
+	ret = -ENOMEM;
+	dir = NULL;
+	spec = kmalloc(req.speclen + 1, GFP_KERNEL);
+	ss = kmalloc(sizeof *ss, GFP_KERNEL);
+	if (!spec || !ss)
+		goto out;
+	ret = -EFAULT;
+	if (copy_from_user(spec, (void __user *)(unsigned long)req.spec,
+			   req.speclen))
+		goto out;
+	spec[req.speclen] = 0;
+	ret = -EINVAL;
+	if (strlen(spec) != req.speclen)
+		goto out;
+	ods5_debug(2, "spec: %s\n", spec);
+
+	/* skip node and device */
+	p = spec;
+	for (i = 0; spec[i] && spec[i] != '[' && spec[i] != '<'; i++)
+		if (spec[i] == ':')
+			p = &spec[i + 1];
+
+	dir = igrab(sb->s_root->d_inode);
+	fid = mkfid(dir);
+	if (*p == '[' || *p == '<') {
+		close = *p == '[' ? ']' : '>';
+		dirend = strchr(p, close);
+		if (!dirend)
+			goto out;
+		*dirend = 0;
+		comp = p + 1;
+		/* [000000] and [000000.X] start at the MFD, so does [.X] */
+		if (strncmp(comp, "000000", 6) == 0
+		    && (comp[6] == 0 || comp[6] == '.'))
+			comp += comp[6] ? 7 : 6;
+		else if (*comp == '.')
+			comp++;
+		for (; *comp; comp = next) {
+			next = strchr(comp, '.');
+			if (next)
+				*next++ = 0;
+			else
+				next = comp + strlen(comp);
+			l = name_to_isl(sb_info, comp, strlen(comp), ss->pat);
+			if (l <= 0 || l > ODS5_FILENAME_LEN - 4) {
+				ret = -EINVAL;
+				goto out;
+			}
+			/* no wildcards and no [-] */
+			if (l == 1 && ss->pat[0] == '-') {
+				ret = -EINVAL;
+				goto out;
+			}
+			for (i = 0; i < l; i++) {
+				if (ss->pat[i] == '*' || ss->pat[i] == '%') {
+					ret = -EINVAL;
+					goto out;
+				}
+				ss->pat[i] = toupper(ss->pat[i]);
+			}
+			memcpy(&ss->pat[l], ".DIR", 4);
+			ss->pl = ss->prefl = l + 4;
+			ss->vmode = VER_EXACT;
+			ss->vnum = 1;
+			ret = walk_entry(&dir, ss, &fid);
+			if (ret)
+				goto out;
+			if (!S_ISDIR(dir->i_mode)) {
+				ret = -ENOTDIR;
+				goto out;
+			}
+		}
+		p = dirend + 1;
+	}
+	if (*p) {
+		ret = parse_pattern(sb_info, ss, p, strlen(p), 0);
+		if (ret)
+			goto out;
+		ret = walk_entry(&dir, ss, &fid);
+		if (ret)
+			goto out;
+	}
+
+	req.fid = fid;
+	req.fd = (vms_long)-1;
+	file = NULL;
+	fd = -1;
+	if (req.flags & ODS5_FILESPEC_OPEN) {
+		fd = open_inode(filp, dir, &file);
+		if (fd < 0) {
+			ret = fd;
+			goto out;
+		}
+		req.fd = fd;
+	}
+	ret = 0;
+	if (copy_to_user((void __user *)arg, &req, sizeof req)) {
+		ret = -EFAULT;
+		if (file) {
+			put_unused_fd(fd);
+			fput(file);
+		}
+	} else if (file)
+		fd_install(fd, file);
+out:
+	if (dir)
+		iput(dir);
+	kfree(ss);
+	kfree(spec);
+	return ret;
+}
@@ -0,0 +1,152 @@
+/*
+ * linux/fs/ods5/slow.c
+ *
+ * This file is part of the OpenVMS ODS5 file system for Linux.
+ * Copyright (C) 2017 Hartmut Becker.
+ *
+ * The OpenVMS ODS5 file system for Linux is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The OpenVMS ODS5 file system for Linux is distributed in the hope that it
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/fs.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+
+#include "./ods5_fs.h"
+#include "./ods5.h"
+
+/*
+ * Slow operation log.
+ * Lookups, readdir batches, header reads and file reads which take longer
+ * than /sys/fs/ods5/<device>/slow_us are recorded in a ring of the last
+ * ODS5_SLOW_RING entries, which is shown in debugfs, in
+ * /sys/kernel/debug/ods5/<device>/slow_ops. With slow_us 0, the default,
+ * nothing is timed. The extension headers walked are taken from a counter
+ * of the inode, so concurrent operations on the same file may see each
+ * other's walks.
+ */
+
+typedef struct ods5_slow {
+	u64 when;		/* ktime_get_ns at the end */
+	u64 ns;			/* elapsed */
+	unsigned long ino;
+	vms_long blocks;
+	vms_word headers;
+	vms_byte op;
+	char name[ODS5_SLOW_NAME];
+} _ODS5_SLOW;
+
+static const char *slow_ops[] = {
+	[ODS5_SLOW_LOOKUP] = "lookup",
+	[ODS5_SLOW_READDIR] = "readdir",
+	[ODS5_SLOW_HEADER] = "header",
+	[ODS5_SLOW_READ] = "read",
+};
+
+int ods5_slow_init(struct ods5_sb_info *sb_info)
+{
+	spin_lock_init(&sb_info->slow_lock);
+	sb_info->slow_head = 0;
+	sb_info->slow_count = 0;
+	sb_info->slow_ns = 0;
+	sb_info->slow = kvcalloc(ODS5_SLOW_RING, sizeof *sb_info->slow,
+				 GFP_KERNEL);
+	if (!sb_info->slow)
+		return -ENOMEM;
+	return 0;
+}
+
+void ods5_slow_free(struct ods5_sb_info *sb_info)
+{
+	kvfree(sb_info->slow);
+	sb_info->slow = NULL;
+}
+
+void ods5_slow_start(struct super_block *sb, struct inode *inode,
+		     struct ods5_slow_op *so)
+{
+	struct ods5_fh_info *fh_info;
+
+	so->start = 0;
+	if (!READ_ONCE(get_sb_info(sb)->slow_ns))
+		return;
+	so->start = ktime_get_ns();
+	so->walked = 0;
+	if (inode && inode->i_private) {
+		fh_info = inode->i_private;
+		so->walked = atomic_read(&fh_info->walked);
+	}
+}
+
+void ods5_slow_end(struct super_block *sb, struct inode *inode,
+		   struct ods5_slow_op *so, int op, unsigned long ino,
+		   const unsigned char *name, int namelen, vms_long blocks)
+{
+	struct ods5_sb_info *sb_info;
+	struct ods5_fh_info *fh_info;
+	struct ods5_slow *e;
+	u64 now, ns;
+	int walked;
+
+	if (!so->start)
+		return;
+	sb_info = get_sb_info(sb);
+	now = ktime_get_ns();
+	ns = now - so->start;
+	if (ns < READ_ONCE(sb_info->slow_ns))
+		return;
+	walked = 0;
+	if (inode && inode->i_private) {
+		fh_info = inode->i_private;
+		walked = atomic_read(&fh_info->walked) - so->walked;
+	}
+	if (namelen > ODS5_SLOW_NAME - 1)
+		namelen = ODS5_SLOW_NAME - 1;
+
+	spin_lock(&sb_info->slow_lock);
+	e = &sb_info->slow[sb_info->slow_head];
+	sb_info->slow_head = (sb_info->slow_head + 1) % ODS5_SLOW_RING;
+	if (sb_info->slow_count < ODS5_SLOW_RING)
+		sb_info->slow_count++;
+	e->when = now;
+	e->ns = ns;
+	e->ino = ino;
+	e->blocks = blocks;
+	e->headers = walked;
+	e->op = op;
+	memcpy(e->name, name, namelen);
+	e->name[namelen] = 0;
+	spin_unlock(&sb_info->slow_lock);
+}
+
+/* the ring, oldest first */
+void ods5_slow_show(struct ods5_sb_info *sb_info, struct seq_file *m)
+{
+	struct ods5_slow *e;
+	vms_long i, n;
+
+	seq_puts(m, "# when_ns op ino blocks headers elapsed_us name\n");
+	spin_lock(&sb_info->slow_lock);
+	n = sb_info->slow_count;
+	for (i = 0; i < n; i++) {
+		e = &sb_info->slow[(sb_info->slow_head + ODS5_SLOW_RING - n + i)
+				   % ODS5_SLOW_RING];
+		seq_printf(m, "%llu %s %lu %u %u %llu %s\n", e->when,
+			   slow_ops[e->op], e->ino, e->blocks, e->headers,
+			   div_u64(e->ns, NSEC_PER_USEC), e->name);
+	}
+	spin_unlock(&sb_info->slow_lock);
+}
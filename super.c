@@ -43,9 +43,38 @@ MODULE_DESCRIPTION("ODS5 Filesystem " ODS5_MODDEBUG);
 MODULE_AUTHOR("Hartmut Becker");
 MODULE_VERSION(ODS5_MODVER);
 
+#define CREATE_TRACE_POINTS
+#include "./ods5_trace.h"
+
 #ifdef DEBUG
 int ods5_debug_level = 0;
-module_param(ods5_debug_level, int, 0644);
+DEFINE_STATIC_KEY_FALSE(ods5_debug_key);
+
+/* the static key follows the level */
+static void ods5_debug_update(void)
+{
+	if (READ_ONCE(ods5_debug_level) > 0)
+		static_branch_enable(&ods5_debug_key);
+	else
+		static_branch_disable(&ods5_debug_key);
+}
+
+static int ods5_debug_set(const char *val, const struct kernel_param *kp)
+{
+	int ret;
+
+	ret = param_set_int(val, kp);
+	if (ret == 0)
+		ods5_debug_update();
+	return ret;
+}
+
+static const struct kernel_param_ops ods5_debug_ops = {
+	.set = ods5_debug_set,
+	.get = param_get_int,
+};
+
+module_param_cb(ods5_debug_level, &ods5_debug_ops, &ods5_debug_level, 0644);
 MODULE_PARM_DESC(ods5_debug_level, " >0 - write debug info into the kernel message buffer; default = 0; changeable with sysctl");
 #endif
 
@@ -73,26 +102,30 @@ extern struct file_operations ods5_dir_operations;
 extern struct file_operations ods5_file_operations;
 extern struct inode_operations ods5_inode_operations;
 extern struct inode_operations ods5_inode_symlink_ops;
+extern struct inode_operations ods5_file_inode_operations;
 extern const struct xattr_handler *ods5_xattr_handlers[];
+extern const struct export_operations ods5_export_ops;
 
-static void fill_fh_info (struct ods5_fh_info *fh_info, struct ods5_fh2 *fh2)
+static void fill_fh_info (struct ods5_fh_info *fh_info, struct ods5_hdr *hdr,
+			  vms_word *map)
 {
-	memcpy (&fh_info->recattr, &fh2->recattr, sizeof fh_info->recattr);
-	memcpy (&fh_info->ext.ext_fid, &fh2->ext_fid, sizeof fh_info->ext.ext_fid);
-	ods5_debug(2, "map_inuse: 0x%02x, mpoffset: 0x%02x\n",
-		   fh2->map_inuse, fh2->mpoffset);
-	fh_info->ext.map_inuse = fh2->map_inuse;
-	memcpy (&fh_info->ext.map[0], &((vms_word*)fh2)[fh2->mpoffset], sizeof(vms_word)*fh2->map_inuse);
+	memcpy (&fh_info->recattr, &hdr->recattr, sizeof fh_info->recattr);
+	memcpy (&fh_info->ext.ext_fid, &hdr->ext_fid, sizeof fh_info->ext.ext_fid);
+	memcpy (&fh_info->backlink, &hdr->backlink, sizeof fh_info->backlink);
+	ods5_debug(2, "map_inuse: 0x%02x\n", hdr->map_inuse);
+	fh_info->ext.map_inuse = hdr->map_inuse;
+	memcpy (&fh_info->ext.map[0], map, sizeof(vms_word)*hdr->map_inuse);
 }
 
-struct buffer_head *ods5_read_fh (struct super_block *sb, int fnum, struct ods5_fh2 **fh2)
+struct ods5_fh2 *ods5_read_fh (struct super_block *sb, int fnum, struct ods5_mblk *mb)
 {
+	struct ods5_fh2 *fh2;
+	struct ods5_slow_op so;
 	vms_long lbn;
 	vms_long unused;
-	struct buffer_head *bh;
-	vms_long iopos;
 	struct ods5_sb_info *sb_info;
 	sb_info = get_sb_info(sb);
+	ods5_slow_start(sb, NULL, &so);
 	
         if (fnum <= ODS5_LAST_FIXED_FH)
 		lbn = sb_info->indexflbn + fnum - 1;
@@ -108,15 +141,17 @@ struct buffer_head *ods5_read_fh (struct super_block *sb, int fnum, struct ods5_
 		sb_info->clustersize * 4 + sb_info->ibmapsize + fnum, &lbn,
 		&unused);
 	   iput (indexf_inode);
-	   if (!ret)
-	     return NULL;;
+	   if (!ret) {
+	     trace_ods5_read_fh(sb, fnum, 0, 0);
+	     return NULL;
+	   }
 	}
 
 	/* read it */
-    bh = ods5_bread(sb, lbn, &iopos);
-	if (bh != NULL)
-		*fh2 = (struct ods5_fh2 *)(bh->b_data + iopos);
-	return bh;
+	fh2 = (struct ods5_fh2 *)ods5_mread(sb, lbn, mb);
+	trace_ods5_read_fh(sb, fnum, lbn, fh2 != NULL);
+	ods5_slow_end(sb, NULL, &so, ODS5_SLOW_HEADER, fnum, "", 0, 1);
+	return fh2;
 }
 
 /*
@@ -214,130 +249,179 @@ static loff_t adjust_size(struct inode *inode) {
 	return inode->i_size+incr;
 }
 
+#define DENY_READ 0x01
+#define DENY_WRITE 0x02
+#define DENY_EXEC 0x04
+#define DENY_DEL 0x08
+
+/* take what the inode needs from a valid file header, see hdrcache.c */
+static void decode_fh2(struct ods5_sb_info *sb_info, struct ods5_fh2 *fh2,
+		       struct ods5_hdr *hdr)
+{
+	struct fat_block *b;
+	struct ods5_fi2 *fi2;
+	struct ods5_fi5 *fi5;
+
+	memset(hdr, 0, offsetof(struct ods5_hdr, map));
+	hdr->seq = fh2->fid.seq;
+	memcpy (&hdr->recattr, &fh2->recattr, sizeof hdr->recattr);
+	memcpy (&hdr->ext_fid, &fh2->ext_fid, sizeof hdr->ext_fid);
+	memcpy (&hdr->backlink, &fh2->backlink, sizeof hdr->backlink);
+	ods5_debug(2, "map_inuse: 0x%02x, mpoffset: 0x%02x\n",
+		   fh2->map_inuse, fh2->mpoffset);
+	hdr->map_inuse = fh2->map_inuse;
+	if (fh2->map_inuse <= ODS5_HDR_MAXMAP)
+		memcpy (&hdr->map[0], &((vms_word*)fh2)[fh2->mpoffset],
+			sizeof(vms_word)*fh2->map_inuse);
+
+	ods5_debug(2, "filechar: 0x%08x\n", *(vms_long *) (&fh2->filechar));
+	if (fh2->filechar.directory)
+		hdr->mode = S_IFDIR;
+	else if ((fh2->recattr.rtype.fileorg==FAT_SPECIAL)
+		 && (*(vms_byte*)(&fh2->recattr.rattrib)==FAT_SYMBOLIC_LINK))
+		hdr->mode = S_IFLNK;
+	else
+		hdr->mode = S_IFREG;
+
+	if ((fh2->fileprot.owner & DENY_READ) == 0)
+		hdr->mode |= S_IRUSR;
+	if ((fh2->fileprot.owner & DENY_WRITE) == 0)
+		hdr->mode |= S_IWUSR;
+	if ((fh2->fileprot.owner & DENY_EXEC) == 0)
+		hdr->mode |= S_IXUSR;
+	if ((fh2->fileprot.group & DENY_READ) == 0)
+		hdr->mode |= S_IRGRP;
+	if ((fh2->fileprot.group & DENY_WRITE) == 0)
+		hdr->mode |= S_IWGRP;
+	if ((fh2->fileprot.group & DENY_EXEC) == 0)
+		hdr->mode |= S_IXGRP;
+	if ((fh2->fileprot.world & DENY_READ) == 0)
+		hdr->mode |= S_IROTH;
+	if ((fh2->fileprot.world & DENY_WRITE) == 0)
+		hdr->mode |= S_IWOTH;
+	if ((fh2->fileprot.world & DENY_EXEC) == 0)
+		hdr->mode |= S_IXOTH;
+	hdr->fileowner = fh2->fileowner;
+
+	b = &fh2->recattr.hiblk;
+	hdr->blocks = (b->high << 16) + b->low;
+	b = &fh2->recattr.efblk;
+	hdr->size = (((loff_t)(b->high) << 16) + b->low - 1) * ODS5_BLOCK_SIZE
+			+ fh2->recattr.ffbyte;
+	hdr->nlink = 1;
+	if (fh2->idoffset == 0)
+		return;
+	hdr->times = 1;
+	if ((fh2->struclev >> 8) == 2) {
+		fi2 = (struct ods5_fi2 *)&((vms_word *) fh2)[fh2->idoffset];
+		hdr->ctime = fi2->credate;
+		hdr->mtime = hdr->atime = fi2->revdate;
+	} else { /* ((fh2->struclev >> 8) == 5) */
+		fi5 = (struct ods5_fi5 *)&((vms_word *) fh2)[fh2->idoffset];
+		hdr->ctime = fi5->attdate;
+		hdr->mtime = fi5->revdate;
+		hdr->atime = fi5->accdate;
+		if (sb_info->volchar /* & ODS5_VOL_HARDLINKS */)
+			hdr->nlink = fh2->linkcount;
+	}
+}
+
 #define GOOD_RETURN goto good
 #define BAD_RETURN goto bad
 #define BAD_BRELSE_RETURN goto bad_brelse
 void ods5_read_inode(struct inode *inode)
 {
-	struct fat_block *b;
 	struct ods5_fid fid;
 	struct ods5_fh2 *fh2;
-	struct ods5_fi2 *fi2;
-	struct ods5_fi5 *fi5;
-	struct buffer_head *bh;
+	struct ods5_hdr hdr;
+	struct ods5_mblk mb;
 	struct ods5_sb_info *sb_info;
 	struct ods5_fh_info *fh_info;
+	vms_word *map;
 	unsigned long tmp_seq;
 
-	bh = ods5_read_fh(inode->i_sb, inode->i_ino, &fh2);
-	if (bh == NULL) {
-	     ods5_debug(1, "ods5_read_fh for ino %lu failed\n", inode->i_ino);
-	     BAD_RETURN;
-	}
-
-	/*
-	 * fid = mkfid(inode)
-	 * seq is not yet in fh_info, so manually construct the fid
-	 */
-	fid.num = (vms_word) inode->i_ino;
+	sb_info = get_sb_info(inode->i_sb);
 	/* seq is really vms_word, but casting from a void* to unsigned short gives a warning, this cast does not */
 	tmp_seq = (unsigned long)inode->i_private;
-	fid.seq = (vms_word) tmp_seq;
-	fid.rvn = 0;
-	fid.nmx = (vms_byte) (inode->i_ino >> 16);
+	mb.folio = NULL;
 
-	/* check the file header */
-	if (!is_used_fh2(fh2, fid))
-	        BAD_BRELSE_RETURN;
+	/* decoded before, the inode was evicted since */
+	if (ods5_hdr_get(sb_info, inode->i_ino, (vms_word)tmp_seq, &hdr)) {
+		map = &hdr.map[0];
+	} else {
+		fh2 = ods5_read_fh(inode->i_sb, inode->i_ino, &mb);
+		if (fh2 == NULL) {
+		     ods5_debug(1, "ods5_read_fh for ino %lu failed\n", inode->i_ino);
+		     BAD_RETURN;
+		}
 
-	fh_info = kmalloc (sizeof *fh_info+sizeof(vms_word)*fh2->map_inuse, GFP_NOFS);
+		/*
+		 * fid = mkfid(inode)
+		 * seq is not yet in fh_info, so manually construct the fid
+		 */
+		fid.num = (vms_word) inode->i_ino;
+		fid.seq = (vms_word) tmp_seq;
+		fid.rvn = 0;
+		fid.nmx = (vms_byte) (inode->i_ino >> 16);
+
+		/* check the file header */
+		if (!is_used_fh2(fh2, fid))
+			BAD_BRELSE_RETURN;
+		decode_fh2(sb_info, fh2, &hdr);
+		map = &((vms_word*)fh2)[fh2->mpoffset];
+		ods5_hdr_put(sb_info, inode->i_ino, &hdr);
+	}
+
+	fh_info = kmalloc (sizeof *fh_info+sizeof(vms_word)*hdr.map_inuse, GFP_NOFS);
 	if (!fh_info)
 	        BAD_BRELSE_RETURN;
 
 	memset (fh_info, 0, sizeof *fh_info);
         sema_init (&fh_info->ext_lock, 1);
+	fh_info->inode = inode;
+	INIT_LIST_HEAD(&fh_info->cache.lru);
+	fh_info->cache.type = ODS5_CACHE_INODE;
 	fh_info->fid_seq= (vms_word)tmp_seq;
+	inode->i_generation = fh_info->fid_seq;
 
         inode->i_private = fh_info;
-	fill_fh_info (inode->i_private, fh2);
+	fill_fh_info (inode->i_private, &hdr, map);
 
-	ods5_debug(2, "filechar: 0x%08x\n", *(vms_long *) (&fh2->filechar));
-	if (fh2->filechar.directory) {
-		inode->i_mode = S_IFDIR;
+	if (S_ISDIR(hdr.mode)) {
 		inode->i_op = &ods5_inode_operations;
 		inode->i_fop = &ods5_dir_operations;
 	} else {
-		if ((fh2->recattr.rtype.fileorg==FAT_SPECIAL)
-		    && (*(vms_byte*)(&fh2->recattr.rattrib)==FAT_SYMBOLIC_LINK)) {
-			inode->i_mode = S_IFLNK;
+		if (S_ISLNK(hdr.mode))
 			inode->i_op = &ods5_inode_symlink_ops;
-		} else {
-			inode->i_mode = S_IFREG;
-			inode->i_op = &ods5_inode_operations; /* ??? needed for regular files ? */
-		}
+		else
+			inode->i_op = &ods5_file_inode_operations;
 		inode->i_fop = &ods5_file_operations; /* ??? needed for symlinks ? */
 	}
 
-#define DENY_READ 0x01
-#define DENY_WRITE 0x02
-#define DENY_EXEC 0x04
-#define DENY_DEL 0x08
-
-	if ((fh2->fileprot.owner & DENY_READ) == 0)
-		inode->i_mode |= S_IRUSR;
-	if ((fh2->fileprot.owner & DENY_WRITE) == 0)
-		inode->i_mode |= S_IWUSR;
-	if ((fh2->fileprot.owner & DENY_EXEC) == 0)
-		inode->i_mode |= S_IXUSR;
-	if ((fh2->fileprot.group & DENY_READ) == 0)
-		inode->i_mode |= S_IRGRP;
-	if ((fh2->fileprot.group & DENY_WRITE) == 0)
-		inode->i_mode |= S_IWGRP;
-	if ((fh2->fileprot.group & DENY_EXEC) == 0)
-		inode->i_mode |= S_IXGRP;
-	if ((fh2->fileprot.world & DENY_READ) == 0)
-		inode->i_mode |= S_IROTH;
-	if ((fh2->fileprot.world & DENY_WRITE) == 0)
-		inode->i_mode |= S_IWOTH;
-	if ((fh2->fileprot.world & DENY_EXEC) == 0)
-		inode->i_mode |= S_IXOTH;
-
-	sb_info = get_sb_info(inode->i_sb);
-	inode->i_mode |= sb_info->mode;
-	i_uid_write(inode, fh2->fileowner.mem);
-	i_gid_write(inode, fh2->fileowner.grp);
+	inode->i_mode = hdr.mode | sb_info->mode;
+	i_uid_write(inode, hdr.fileowner.mem);
+	i_gid_write(inode, hdr.fileowner.grp);
 
 	ods5_debug(2, "i_mode: 0x%08x\n", inode->i_mode);
-	b = &fh2->recattr.hiblk;
-	inode->i_blocks = (b->high << 16) + b->low;
-	b = &fh2->recattr.efblk;
-	inode->i_size = (((loff_t)(b->high) << 16) + b->low - 1) * ODS5_BLOCK_SIZE
-			+ fh2->recattr.ffbyte;
+	inode->i_blocks = hdr.blocks;
+	inode->i_size = hdr.size;
 	if (sb_info->utf8 && S_ISLNK(inode->i_mode))
 		inode->i_size = adjust_size(inode);
-	if (fh2->idoffset == 0) {
+	if (!hdr.times) {
 		inode->i_mtime = inode->i_atime = inode->i_ctime = current_time(inode);
 		GOOD_RETURN;
 	}
-	if ((fh2->struclev >> 8) == 2) {
-		fi2 = (struct ods5_fi2 *)&((vms_word *) fh2)[fh2->idoffset];
-		inode->i_ctime = v2utime(fi2->credate);
-		inode->i_mtime = inode->i_atime = v2utime(fi2->revdate);
-		set_nlink(inode,1);
-	} else { /* ((fh2->struclev >> 8) == 5) */
-		fi5 = (struct ods5_fi5 *)&((vms_word *) fh2)[fh2->idoffset];
-		inode->i_ctime = v2utime(fi5->attdate);
-		inode->i_mtime = v2utime(fi5->revdate);
-		inode->i_atime = v2utime(fi5->accdate);
-		set_nlink(inode,(sb_info->volchar /* & ODS5_VOL_HARDLINKS */)? fh2->linkcount: 1);
-	}
+	inode->i_ctime = v2utime(hdr.ctime);
+	inode->i_mtime = v2utime(hdr.mtime);
+	inode->i_atime = v2utime(hdr.atime);
+	set_nlink(inode, hdr.nlink);
 
 good:
-        brelse(bh);
+        ods5_mrelease(&mb);
         return;
 
 bad_brelse:
-	brelse(bh);
+	ods5_mrelease(&mb);
 bad:
 	inode->i_private = NULL;
         make_bad_inode (inode);
@@ -352,8 +436,7 @@ bad:
 static vms_long get_usedfids(struct super_block *sb, vms_long maxfiles)
 {
 	vms_long vbn, lbn;
-	struct buffer_head *bh;
-	vms_long iopos;
+	struct ods5_mblk mb;
 	vms_long bitmap_bytes;
 	vms_long extends;
 	vms_long *long_bits;
@@ -386,12 +469,11 @@ static vms_long get_usedfids(struct super_block *sb, vms_long maxfiles)
 		if (!ret)
 			return 0;
 		/* read the lbn */
-		bh = ods5_bread(sb, lbn, &iopos);
-		if (bh == NULL) {
-			ods5_debug(1, "ods5_bread of lbn %d failed\n", lbn);
+		long_bits = (vms_long *)ods5_mread(sb, lbn, &mb);
+		if (long_bits == NULL) {
+			ods5_debug(1, "ods5_mread of lbn %d failed\n", lbn);
 			return 0;
 		}
-		long_bits = (vms_long *)(bh->b_data + iopos);
 		for (i = 0; i < 512 / sizeof *long_bits; i++) {
 			if (long_bits[i]) {
 				byte_bits = (vms_byte *) &long_bits[i];
@@ -399,7 +481,7 @@ static vms_long get_usedfids(struct super_block *sb, vms_long maxfiles)
 					usedfids += bit_table[byte_bits[j]];
 			}
 		}
-		brelse(bh);
+		ods5_mrelease(&mb);
 	}
 	ods5_debug(2, "used fids: %d\n", usedfids);
 	return usedfids;
@@ -408,8 +490,7 @@ static vms_long get_usedfids(struct super_block *sb, vms_long maxfiles)
 static vms_long get_freeblocks(struct super_block *sb, vms_long volsize)
 {
 	vms_long vbn, lbn;
-	struct buffer_head *bh;
-	vms_long iopos;
+	struct ods5_mblk mb;
 	vms_long bitmap_blocks;
 	vms_long extends;
 	vms_long freeblocks;
@@ -443,19 +524,18 @@ static vms_long get_freeblocks(struct super_block *sb, vms_long volsize)
 		if (!ret)
 			return 0;
 		/* read the lbn */
-		bh = ods5_bread(sb, lbn, &iopos);
-		if (bh == NULL) {
-			ods5_debug(1, "ods5_bread of lbn %d failed\n", lbn);
+		long_bits = (vms_long *)ods5_mread(sb, lbn, &mb);
+		if (long_bits == NULL) {
+			ods5_debug(1, "ods5_mread of lbn %d failed\n", lbn);
 			return 0;
 		}
-		long_bits = (vms_long *)(bh->b_data + iopos);
 		for (i = 0; i < 512 / sizeof *long_bits; i++)
 			if (long_bits[i]) {
 				byte_bits = (vms_byte *) &long_bits[i];
 				for (j = 0; j < sizeof *long_bits; j++)
 					freeblocks += bit_table[byte_bits[j]];
 			}
-		brelse(bh);
+		ods5_mrelease(&mb);
 	}
 	freeblocks *= sb_info->clustersize;
 	ods5_debug(2, "freeblocks: %d\n", freeblocks);
@@ -467,8 +547,7 @@ static vms_long get_volsize(struct super_block *sb)
 {
 	struct ods5_scb *scb;
 	vms_long lbn;
-	struct buffer_head *bh;
-	vms_long iopos;
+	struct ods5_mblk mb;
 	vms_long unused;
 	vms_long volsize;
 
@@ -488,12 +567,11 @@ static vms_long get_volsize(struct super_block *sb)
 			return 0;
 	  }
 	/* read the lbn */
-	bh = ods5_bread(sb, lbn, &iopos);
-	if (bh == NULL) {
-		ods5_debug(1, "ods5_bread of lbn %d failed\n", lbn);
+	scb = (struct ods5_scb *)ods5_mread(sb, lbn, &mb);
+	if (scb == NULL) {
+		ods5_debug(1, "ods5_mread of lbn %d failed\n", lbn);
 		return 0;
 	}
-	scb = (struct ods5_scb *)(bh->b_data + iopos);
 	volsize = scb->volsize;
 	/* here the scb can be checked (and debug/info can be printed) */
 	ods5_debug(2, "volsize: %d\n", volsize);
@@ -501,7 +579,7 @@ static vms_long get_volsize(struct super_block *sb)
 	ods5_debug(2, "sectors: %d\n", scb->sectors);
 	ods5_debug(2, "tracks: %d\n", scb->tracks);
 	ods5_debug(2, "cylinder: %d\n", scb->cylinder);
-	brelse(bh);
+	ods5_mrelease(&mb);
 	/* volsize is expressed in lbn */
 	return volsize;
 }
@@ -537,6 +615,13 @@ static int ods5_statfs(struct dentry *d, struct kstatfs *buf)
 
 static void ods5_put_super(struct super_block *sb)
 {
+	ods5_unregister_sysfs(sb);
+	ods5_cache_unregister(sb);
+	ods5_hdr_cache_free(get_sb_info(sb));
+	ods5_name_cache_free(get_sb_info(sb));
+	free_percpu(get_sb_info(sb)->stats);
+	ods5_slow_free(get_sb_info(sb));
+	ods5_profile_free(get_sb_info(sb));
 	kfree(sb->s_fs_info);
 	return;
 }
@@ -545,8 +630,14 @@ static void ods5_evict_inode (struct inode *inode) {
 	struct ods5_fh_info *fh_info;
 	struct ods5_ext_info *ext, *next;
         fh_info = inode->i_private;
-	if (!fh_info)
+	if (!fh_info) {
+		/* a bad inode, see ods5_read_inode */
+		clear_inode(inode);
 		return;
+	}
+	ods5_cache_forget(inode);
+	ods5_rms_free(fh_info);
+	ods5_iostat_evict(inode);
 	for (ext=fh_info->ext.next; ext; ext=next) {
 		next = ext->next;
 		kfree (ext);
@@ -567,6 +658,18 @@ static int ods5_show_options(struct seq_file *sf, struct dentry *root) {
 		seq_printf(sf, ",bs=%d", sb_info->blocksize);
 	if (sb_info->mode_opt)
 		seq_printf(sf, ",mode=0%o", sb_info->mode);
+	if (sb_info->ra_opt)
+		seq_printf(sf, ",ra_kb=%d", sb_info->ra_kb);
+	if (sb_info->cache_opt)
+		seq_printf(sf, ",cache_kb=%d", sb_info->cache_kb);
+	if (sb_info->warm_opt)
+		seq_printf(sf, ",warm=%d", sb_info->warm_depth);
+	if (sb_info->records)
+		seq_printf(sf, ",records");
+	if (sb_info->crlf)
+		seq_printf(sf, ",crlf");
+	if (sb_info->prof_opt)
+		seq_printf(sf, ",profile");
 	if (sb_info->nomfd)
 		seq_printf(sf, ",nomfd");
 	if (sb_info->syml)
@@ -626,6 +729,37 @@ static void set_common_options (struct ods5_sb_info *sb_info, char *data) {
 		sb_info->mode_opt = 0;
 	
 	ods5_debug(2, "mode=0%o\n", sb_info->mode);
+
+	if (data && NULL != (optv = strstr(data, "ra_kb="))) {
+		sb_info->ra_opt = 1;
+		sb_info->ra_kb = 0;
+		/* clamped while parsing, so the value can't wrap */
+		for (optv += sizeof "ra_kb=" - 1; *optv >= '0' && *optv <= '9';
+		     optv++) {
+			sb_info->ra_kb = (sb_info->ra_kb * 10) + *optv - '0';
+			if (sb_info->ra_kb > ODS5_RA_MAXKB)
+				sb_info->ra_kb = ODS5_RA_MAXKB;
+		}
+	} else {
+		sb_info->ra_opt = 0;
+		sb_info->ra_kb = ODS5_RA_KB;
+	}
+	ods5_debug(2, "ra_kb=%d\n", sb_info->ra_kb);
+
+	if (data && NULL != (optv = strstr(data, "cache_kb="))) {
+		sb_info->cache_opt = 1;
+		sb_info->cache_kb = 0;
+		for (optv += sizeof "cache_kb=" - 1; *optv >= '0' && *optv <= '9';
+		     optv++) {
+			sb_info->cache_kb = (sb_info->cache_kb * 10) + *optv - '0';
+			if (sb_info->cache_kb > ODS5_CACHE_MAXKB)
+				sb_info->cache_kb = ODS5_CACHE_MAXKB;
+		}
+	} else {
+		sb_info->cache_opt = 0;
+		sb_info->cache_kb = ODS5_CACHE_KB;
+	}
+	ods5_debug(2, "cache_kb=%d\n", sb_info->cache_kb);
 }
 
 static int ods5_remount_fs (struct super_block *sb, int *flags, char *data)  {
@@ -634,6 +768,7 @@ static int ods5_remount_fs (struct super_block *sb, int *flags, char *data)  {
    ods5_debug(2, "flags: %p, *flags: 0x%x\n", flags, *flags);
    ods5_debug(2, "data: %p, *data: %s\n", data, data);
    set_common_options (sb_info, data);
+   ods5_cache_trim_all(sb_info);
    return 0;
 }
 
@@ -645,10 +780,46 @@ static struct super_operations ods5_super_operations = {
 	.show_options = ods5_show_options,
 };
 
+/*
+ * Without bs=, choose the I/O blocksize: as large as the physical block size
+ * of the device (but not larger than a page), at least the logical block
+ * size. A larger blocksize only pays if the ODS5 structures are aligned to
+ * it: the clusters, which are the units of allocation, that is where the
+ * extents start, and the index file bitmap, which is followed by the file
+ * headers. Also the device size must be a multiple, otherwise the last
+ * blocks can't be read. If it doesn't fit, try the next smaller size.
+ * The metadata reads don't depend on this, so the home block is already
+ * read with the initial blocksize.
+ */
+static vms_long auto_blocksize(struct super_block *sb, struct ods5_home *home)
+{
+	vms_long logical, physical, blocksize;
+	loff_t devsize;
+
+	logical = bdev_logical_block_size(sb->s_bdev);
+	physical = bdev_physical_block_size(sb->s_bdev);
+	devsize = bdev_nr_bytes(sb->s_bdev);
+
+	blocksize = physical;
+	if (blocksize > PAGE_SIZE)
+		blocksize = PAGE_SIZE;
+	if (blocksize < logical)
+		blocksize = logical;
+	while (blocksize > logical && blocksize > ODS5_BLOCK_SIZE) {
+		if (((home->cluster << ODS5_BLOCK_SHIFT) & (blocksize - 1)) == 0
+		    && ((home->ibmaplbn << ODS5_BLOCK_SHIFT) & (blocksize - 1)) == 0
+		    && (devsize & (blocksize - 1)) == 0)
+			break;
+		blocksize >>= 1;
+	}
+	ods5_info("blocksize: %d (logical: %d, physical: %d, cluster: %d, ibmaplbn: %d)\n",
+		  blocksize, logical, physical, home->cluster, home->ibmaplbn);
+	return blocksize;
+}
+
 static int ods5_fill_super(struct super_block *sb, void *data, int silent)
 {
-	struct buffer_head *bh;
-	vms_long iopos;
+	struct ods5_mblk mb;
 	struct ods5_home *home;
 	struct inode *inode;
 	struct dentry *root;
@@ -656,6 +827,7 @@ static int ods5_fill_super(struct super_block *sb, void *data, int silent)
 	char *optv;
 	vms_long home_lbn;
 	vms_long blocksize;
+	int error = -EIO;
 
 	ods5_debug(2, "%s\n", "start");
 	ods5_info("options: '%s'\n", data? (char *)data: "<NULL>");
@@ -667,8 +839,25 @@ static int ods5_fill_super(struct super_block *sb, void *data, int silent)
 
 	sb->s_magic = ODS5_MAGIC;
 	sb->s_fs_info = kmalloc(sizeof *sb_info, GFP_KERNEL);
+	if (!sb->s_fs_info)
+		return -ENOMEM;
 	sb_info = get_sb_info(sb);
 	memset(sb_info, 0, sizeof *sb_info);
+	sb_info->sb = sb;
+	sb_info->stats = alloc_percpu(struct ods5_stats);
+	if (!sb_info->stats) {
+		error = -ENOMEM;
+		goto failed;
+	}
+	if (ods5_slow_init(sb_info)) {
+		error = -ENOMEM;
+		goto failed;
+	}
+	ods5_cache_init(sb_info);
+	ods5_hdr_cache_init(sb_info);
+	ods5_name_cache_init(sb_info);
+	ods5_iostat_init(sb_info);
+	ods5_profile_init(sb_info);
 	if (data && NULL != (optv = strstr(data, "bs="))) {
 		blocksize = 0;
 		for (optv += sizeof "bs=" - 1; *optv >= '0' && *optv <= '9';
@@ -684,7 +873,8 @@ static int ods5_fill_super(struct super_block *sb, void *data, int silent)
 				break;
 			default:
 				ods5_info("unsupported filesystem blocksize %d\n", blocksize);
-				return -EINVAL;
+				error = -EINVAL;
+				goto failed;
 		}
 	} else {
 		blocksize = ODS5_BLOCK_SIZE;
@@ -696,7 +886,8 @@ static int ods5_fill_super(struct super_block *sb, void *data, int silent)
 		ods5_info("s_blocksize: %ld\n", sb->s_blocksize);
 	if (sb->s_blocksize < ODS5_BLOCK_SIZE) {
 		ods5_info("bad s_blocksize: %lu, minimum: %d\n", sb->s_blocksize, ODS5_BLOCK_SIZE);
-		return -EINVAL;
+		error = -EINVAL;
+		goto failed;
 	}
     set_common_options (sb_info, data);
 	if (data && NULL != (optv = strstr(data, "home="))) {
@@ -712,25 +903,47 @@ static int ods5_fill_super(struct super_block *sb, void *data, int silent)
 	}
 	ods5_debug(2, "home=0x%x\n", home_lbn);
 
-	for (sb->s_blocksize_bits = ODS5_BLOCK_SHIFT;
-	     (1U << sb->s_blocksize_bits) < sb->s_blocksize;
-	     sb->s_blocksize_bits++) ;
-	if (sb->s_blocksize_bits != ODS5_BLOCK_SHIFT)
-		ods5_debug(2, "s_blocksize_bits: %d\n", sb->s_blocksize_bits);
-	sb_info->ioshifts = sb->s_blocksize_bits - ODS5_BLOCK_SHIFT;
-	sb_info->ioblocks = 1U << sb_info->ioshifts;
+	if (data && NULL != (optv = strstr(data, "warm"))) {
+		sb_info->warm_opt = 1;
+		sb_info->warm_depth = ODS5_WARM_DEPTH;
+		if (optv[sizeof "warm" - 1] == '=') {
+			sb_info->warm_depth = 0;
+			for (optv += sizeof "warm=" - 1; *optv >= '0' && *optv <= '9';
+			     optv++)
+				sb_info->warm_depth = (sb_info->warm_depth * 10) + *optv - '0';
+		}
+		if (sb_info->warm_depth > ODS5_WARM_MAXDEPTH)
+			sb_info->warm_depth = ODS5_WARM_MAXDEPTH;
+	} else
+		sb_info->warm_opt = 0;
+	ods5_debug(2, "warm=%d\n", sb_info->warm_depth);
+
+	/* not with the common options: a remount can't change i_size */
+	if (data && strstr(data, "records"))
+		sb_info->records = 1;
+	else
+		sb_info->records = 0;
+	if (data && strstr(data, "crlf"))
+		sb_info->crlf = 1;
+	else
+		sb_info->crlf = 0;
+	/* from here on, to have the headers of the mount in the profile */
+	if (data && strstr(data, "profile")) {
+		sb_info->prof_opt = 1;
+		if (ods5_profile_start(sb_info))
+			ods5_info("%s: no memory for the profile\n", sb->s_id);
+	}
 
 	sb->s_op = &ods5_super_operations;
 
-	bh = ods5_bread(sb, home_lbn, &iopos);
-	if (bh == NULL) {
-		ods5_info("ods5_bread of home block %d failed\n", home_lbn);
+	home = (struct ods5_home *)ods5_mread(sb, home_lbn, &mb);
+	if (home == NULL) {
+		ods5_info("ods5_mread of home block %d failed\n", home_lbn);
 		goto failed;
 	}
-	home = (struct ods5_home *)(bh->b_data + iopos);
 
 	if (!is_valid_home(home)) {
-		bforget(bh);
+		ods5_mrelease(&mb);
 		goto failed;
 	}
 
@@ -741,7 +954,23 @@ static int ods5_fill_super(struct super_block *sb, void *data, int silent)
 	sb_info->maxfiles = home->maxfiles;
 	sb_info->volsize = 0;
 
-	bforget(bh);
+	if (!sb_info->bs_opt)
+		blocksize = auto_blocksize(sb, home);
+	ods5_mrelease(&mb);
+	/* changing the blocksize drops the cached blocks, don't hold one */
+	if (!sb_info->bs_opt && blocksize != sb->s_blocksize
+	    && !sb_set_blocksize(sb, blocksize))
+		ods5_info("can't set blocksize %d, using %lu\n",
+			  blocksize, sb->s_blocksize);
+
+	for (sb->s_blocksize_bits = ODS5_BLOCK_SHIFT;
+	     (1U << sb->s_blocksize_bits) < sb->s_blocksize;
+	     sb->s_blocksize_bits++) ;
+	if (sb->s_blocksize_bits != ODS5_BLOCK_SHIFT)
+		ods5_debug(2, "s_blocksize_bits: %d\n", sb->s_blocksize_bits);
+	sb_info->ioshifts = sb->s_blocksize_bits - ODS5_BLOCK_SHIFT;
+	sb_info->ioblocks = 1U << sb_info->ioshifts;
+
 	inode = ods5_iget (sb, ODS5_MFD_INO, ODS5_MFD_INO);
 	if (!inode)
 		goto failed;
@@ -755,12 +984,24 @@ static int ods5_fill_super(struct super_block *sb, void *data, int silent)
 	ods5_debug(2, "root: %p\n", root);
 
 	sb->s_xattr = ods5_xattr_handlers;
+	sb->s_export_op = &ods5_export_ops;
 	sb->s_root = root;
+	if (ods5_register_sysfs(sb))
+		ods5_info("%s: no sysfs directory\n", sb->s_id);
+	ods5_debugfs_register(sb);
+	if (ods5_cache_register(sb))
+		ods5_info("%s: no cache shrinker\n", sb->s_id);
+	ods5_warm_start(sb);
+	ods5_prefetch_init(sb);
 	return 0;
 
       failed:
+	ods5_hdr_cache_free(sb_info);
+	free_percpu(sb_info->stats);
+	ods5_slow_free(sb_info);
+	ods5_profile_free(sb_info);
 	kfree(sb->s_fs_info);
-	return -EIO;
+	return error;
 }
 
 static struct dentry * ods5_mount(struct file_system_type *fs_type,
@@ -770,15 +1011,38 @@ static struct dentry * ods5_mount(struct file_system_type *fs_type,
 	return mount_bdev(fs_type, flags, dev_name, data, ods5_fill_super);
 }
 
+/* background work holding inodes must be stopped before they are evicted */
+static void ods5_kill_sb(struct super_block *sb)
+{
+	if (sb->s_root) {
+		/* no inode references from debugfs readers at eviction */
+		ods5_debugfs_unregister(sb);
+		ods5_warm_stop(sb);
+		ods5_prefetch_stop(sb);
+	}
+	kill_block_super(sb);
+}
+
 static struct file_system_type ods5_fs_type = {
 	.name = "ods5",
 	.owner = THIS_MODULE,
 	.mount = ods5_mount,
-	.kill_sb = kill_block_super,
+	.kill_sb = ods5_kill_sb,
 	.fs_flags = FS_REQUIRES_DEV,
 };
 
 #if defined(DEBUG) && defined(CONFIG_SYSCTL)
+static int ods5_debug_sysctl(struct ctl_table *table, int write,
+			     void *buffer, size_t *lenp, loff_t *ppos)
+{
+	int ret;
+
+	ret = proc_dointvec(table, write, buffer, lenp, ppos);
+	if (ret == 0 && write)
+		ods5_debug_update();
+	return ret;
+}
+
 /* Definition of the ods5 sysctl. */
 static struct ctl_table ods5_sysctls[] = {
         {
@@ -786,7 +1050,7 @@ static struct ctl_table ods5_sysctls[] = {
                 .data           = &ods5_debug_level,          /* Data pointer and size. */
                 .maxlen         = sizeof(ods5_debug_level),
                 .mode           = 0644,                 /* Mode, proc handler. */
-                .proc_handler   = proc_dointvec
+                .proc_handler   = ods5_debug_sysctl
         },
         {}
 };
@@ -828,9 +1092,20 @@ static int ods5_sysctl(int add)
 
 static int __init init_ods5_fs(void)
 {
+	int err;
 	ods5_info("ODS5 Filesystem %s %s\n", ODS5_MODVER, ODS5_MODDEBUG);
+	err = ods5_sysfs_init();
+	if (err)
+		return err;
 	ods5_sysctl(1);
-	return register_filesystem(&ods5_fs_type);
+	ods5_debugfs_init();
+	err = register_filesystem(&ods5_fs_type);
+	if (err) {
+		ods5_debugfs_exit();
+		ods5_sysctl(0);
+		ods5_sysfs_exit();
+	}
+	return err;
 }
 
 static void __exit exit_ods5_fs(void)
@@ -838,6 +1113,8 @@ static void __exit exit_ods5_fs(void)
 	ods5_info("ODS5 Filesystem %s %s\n", ODS5_MODVER, ODS5_MODDEBUG);
 	ods5_sysctl(0);
 	unregister_filesystem(&ods5_fs_type);
+	ods5_debugfs_exit();
+	ods5_sysfs_exit();
 }
 
 module_init(init_ods5_fs)
@@ -0,0 +1,368 @@
+/*
+ * linux/fs/ods5/sysfs.c
+ *
+ * This file is part of the OpenVMS ODS5 file system for Linux.
+ * Copyright (C) 2017 Hartmut Becker.
+ *
+ * The OpenVMS ODS5 file system for Linux is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The OpenVMS ODS5 file system for Linux is distributed in the hope that it
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/fs.h>
+#include <linux/kobject.h>
+#include <linux/math64.h>
+#include <linux/percpu.h>
+#include <linux/sysfs.h>
+
+#include "./ods5_fs.h"
+#include "./ods5.h"
+
+/*
+ * Per mounted volume there is a directory /sys/fs/ods5/<device>/. The
+ * kobject is embedded in the sb_info, so the sb_info can't be freed before
+ * the kobject is released: ods5_unregister_sysfs waits for that.
+ * The performance counters are per CPU, a read sums them up, so the hot
+ * paths only do a this_cpu_add.
+ */
+
+static struct kset *ods5_kset;
+
+struct ods5_attr {
+	struct attribute attr;
+	ssize_t (*show)(struct ods5_sb_info *, char *);
+	ssize_t (*store)(struct ods5_sb_info *, const char *, size_t);
+};
+
+#define ODS5_ATTR_RO(name) \
+static struct ods5_attr ods5_attr_##name = __ATTR(name, 0444, name##_show, NULL)
+#define ODS5_ATTR_RW(name) \
+static struct ods5_attr ods5_attr_##name = __ATTR(name, 0644, name##_show, name##_store)
+
+static const char *ods5_states[] = {
+	[ODS5_WARM_OFF] = "off",
+	[ODS5_WARM_QUEUED] = "queued",
+	[ODS5_WARM_RUNNING] = "running",
+	[ODS5_WARM_DONE] = "done",
+	[ODS5_WARM_STOPPED] = "stopped",
+};
+
+static ssize_t warm_state_show(struct ods5_sb_info *sb_info, char *buf)
+{
+	return sysfs_emit(buf, "%s\n", ods5_states[READ_ONCE(sb_info->warm_state)]);
+}
+ODS5_ATTR_RO(warm_state);
+
+static ssize_t warm_headers_show(struct ods5_sb_info *sb_info, char *buf)
+{
+	return sysfs_emit(buf, "%d\n", atomic_read(&sb_info->warm_headers));
+}
+ODS5_ATTR_RO(warm_headers);
+
+static ssize_t warm_dirs_show(struct ods5_sb_info *sb_info, char *buf)
+{
+	return sysfs_emit(buf, "%d\n", atomic_read(&sb_info->warm_dirs));
+}
+ODS5_ATTR_RO(warm_dirs);
+
+static ssize_t warm_blocks_show(struct ods5_sb_info *sb_info, char *buf)
+{
+	return sysfs_emit(buf, "%d\n", atomic_read(&sb_info->warm_blocks));
+}
+ODS5_ATTR_RO(warm_blocks);
+
+static ssize_t prefetch_state_show(struct ods5_sb_info *sb_info, char *buf)
+{
+	return sysfs_emit(buf, "%s\n", ods5_states[READ_ONCE(sb_info->pf_state)]);
+}
+ODS5_ATTR_RO(prefetch_state);
+
+static ssize_t prefetch_files_show(struct ods5_sb_info *sb_info, char *buf)
+{
+	return sysfs_emit(buf, "%d/%d\n", atomic_read(&sb_info->pf_files),
+			  sb_info->pf_nfids);
+}
+ODS5_ATTR_RO(prefetch_files);
+
+static ssize_t prefetch_blocks_show(struct ods5_sb_info *sb_info, char *buf)
+{
+	return sysfs_emit(buf, "%d\n", atomic_read(&sb_info->pf_blocks));
+}
+ODS5_ATTR_RO(prefetch_blocks);
+
+/* the performance counters, summed up over all CPUs */
+static u64 stat_sum(struct ods5_sb_info *sb_info, int stat)
+{
+	u64 sum;
+	int cpu;
+
+	sum = 0;
+	for_each_possible_cpu(cpu)
+		sum += per_cpu_ptr(sb_info->stats, cpu)->c[stat];
+	return sum;
+}
+
+#define ODS5_STAT_ATTR(name, stat) \
+static ssize_t name##_show(struct ods5_sb_info *sb_info, char *buf) \
+{ \
+	return sysfs_emit(buf, "%llu\n", stat_sum(sb_info, stat)); \
+} \
+ODS5_ATTR_RO(name)
+
+ODS5_STAT_ATTR(meta_reads, ODS5_ST_MREAD);
+ODS5_STAT_ATTR(data_reads, ODS5_ST_BREAD);
+ODS5_STAT_ATTR(lookups, ODS5_ST_LOOKUP);
+ODS5_STAT_ATTR(lookups_negative, ODS5_ST_LOOKUP_NEG);
+ODS5_STAT_ATTR(lookup_blocks, ODS5_ST_LOOKUP_BLOCKS);
+ODS5_STAT_ATTR(ext_headers_loaded, ODS5_ST_EXT_LOAD);
+ODS5_STAT_ATTR(mapvbn_calls, ODS5_ST_MAPVBN);
+ODS5_STAT_ATTR(mapvbn_pointers, ODS5_ST_MAP_PTRS);
+ODS5_STAT_ATTR(readdir_blocks, ODS5_ST_READDIR_BLOCKS);
+ODS5_STAT_ATTR(readdir_entries, ODS5_ST_READDIR_ENTRIES);
+ODS5_STAT_ATTR(name_cache_hits, ODS5_ST_NAME_HIT);
+ODS5_STAT_ATTR(name_cache_misses, ODS5_ST_NAME_MISS);
+ODS5_STAT_ATTR(rms_index_hits, ODS5_ST_RMS_HIT);
+ODS5_STAT_ATTR(rms_index_builds, ODS5_ST_RMS_BUILD);
+ODS5_STAT_ATTR(header_cache_hits, ODS5_ST_HDR_HIT);
+ODS5_STAT_ATTR(header_cache_misses, ODS5_ST_HDR_MISS);
+
+/* pointers decoded per mapvbn call, with two decimals */
+static ssize_t mapvbn_pointers_avg_show(struct ods5_sb_info *sb_info, char *buf)
+{
+	u64 calls, ptrs;
+
+	calls = stat_sum(sb_info, ODS5_ST_MAPVBN);
+	ptrs = stat_sum(sb_info, ODS5_ST_MAP_PTRS);
+	if (calls == 0)
+		return sysfs_emit(buf, "0.00\n");
+	ptrs = div64_u64(ptrs * 100, calls);
+	return sysfs_emit(buf, "%llu.%02llu\n", ptrs / 100, ptrs % 100);
+}
+ODS5_ATTR_RO(mapvbn_pointers_avg);
+
+/* directory blocks per lookup, the upper bound of each bucket and its count */
+static ssize_t lookup_blocks_hist_show(struct ods5_sb_info *sb_info, char *buf)
+{
+	u64 hist[ODS5_LOOKUP_HIST];
+	int cpu, h, n;
+
+	memset(hist, 0, sizeof hist);
+	for_each_possible_cpu(cpu)
+		for (h = 0; h < ODS5_LOOKUP_HIST; h++)
+			hist[h] += per_cpu_ptr(sb_info->stats, cpu)->lookup_hist[h];
+	for (h = n = 0; h < ODS5_LOOKUP_HIST - 1; h++)
+		n += sysfs_emit_at(buf, n, "%d:%llu ", 1 << h, hist[h]);
+	n += sysfs_emit_at(buf, n, "+:%llu\n", hist[h]);
+	return n;
+}
+ODS5_ATTR_RO(lookup_blocks_hist);
+
+/* the files with the most blocks read from disk, see iostat.c */
+static ssize_t top_files_show(struct ods5_sb_info *sb_info, char *buf)
+{
+	return ods5_iostat_top(sb_info, buf);
+}
+ODS5_ATTR_RO(top_files);
+
+/* the memory of the driver caches, see cache.c */
+static ssize_t cache_bytes_show(struct ods5_sb_info *sb_info, char *buf)
+{
+	return sysfs_emit(buf, "%lu\n", READ_ONCE(sb_info->cache_total));
+}
+ODS5_ATTR_RO(cache_bytes);
+
+static ssize_t cache_usage_show(struct ods5_sb_info *sb_info, char *buf)
+{
+	return ods5_cache_usage(sb_info, buf);
+}
+ODS5_ATTR_RO(cache_usage);
+
+static ssize_t cache_budget_kb_show(struct ods5_sb_info *sb_info, char *buf)
+{
+	return sysfs_emit(buf, "%u\n", READ_ONCE(sb_info->cache_kb));
+}
+
+static ssize_t cache_budget_kb_store(struct ods5_sb_info *sb_info,
+				     const char *buf, size_t len)
+{
+	unsigned int kb;
+	int ret;
+
+	ret = kstrtouint(buf, 0, &kb);
+	if (ret)
+		return ret;
+	if (kb > ODS5_CACHE_MAXKB)
+		return -EINVAL;
+	WRITE_ONCE(sb_info->cache_kb, kb);
+	ods5_cache_trim_all(sb_info);
+	return len;
+}
+ODS5_ATTR_RW(cache_budget_kb);
+
+/* the threshold of the slow operation log, in microseconds, 0 is off */
+static ssize_t slow_us_show(struct ods5_sb_info *sb_info, char *buf)
+{
+	return sysfs_emit(buf, "%llu\n",
+			  div_u64(READ_ONCE(sb_info->slow_ns), NSEC_PER_USEC));
+}
+
+static ssize_t slow_us_store(struct ods5_sb_info *sb_info, const char *buf,
+			     size_t len)
+{
+	u64 us;
+	int ret;
+
+	ret = kstrtoull(buf, 0, &us);
+	if (ret)
+		return ret;
+	if (us > U64_MAX / NSEC_PER_USEC)
+		return -EINVAL;
+	WRITE_ONCE(sb_info->slow_ns, us * NSEC_PER_USEC);
+	return len;
+}
+ODS5_ATTR_RW(slow_us);
+
+/* any write clears all counters */
+static ssize_t stats_reset_store(struct ods5_sb_info *sb_info,
+				 const char *buf, size_t len)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(sb_info->stats, cpu), 0,
+		       sizeof(struct ods5_stats));
+	return len;
+}
+static struct ods5_attr ods5_attr_stats_reset =
+	__ATTR(stats_reset, 0200, NULL, stats_reset_store);
+
+static struct attribute *ods5_attrs[] = {
+	&ods5_attr_warm_state.attr,
+	&ods5_attr_warm_headers.attr,
+	&ods5_attr_warm_dirs.attr,
+	&ods5_attr_warm_blocks.attr,
+	&ods5_attr_prefetch_state.attr,
+	&ods5_attr_prefetch_files.attr,
+	&ods5_attr_prefetch_blocks.attr,
+	&ods5_attr_meta_reads.attr,
+	&ods5_attr_data_reads.attr,
+	&ods5_attr_lookups.attr,
+	&ods5_attr_lookups_negative.attr,
+	&ods5_attr_lookup_blocks.attr,
+	&ods5_attr_lookup_blocks_hist.attr,
+	&ods5_attr_ext_headers_loaded.attr,
+	&ods5_attr_mapvbn_calls.attr,
+	&ods5_attr_mapvbn_pointers.attr,
+	&ods5_attr_mapvbn_pointers_avg.attr,
+	&ods5_attr_readdir_blocks.attr,
+	&ods5_attr_readdir_entries.attr,
+	&ods5_attr_name_cache_hits.attr,
+	&ods5_attr_name_cache_misses.attr,
+	&ods5_attr_rms_index_hits.attr,
+	&ods5_attr_rms_index_builds.attr,
+	&ods5_attr_header_cache_hits.attr,
+	&ods5_attr_header_cache_misses.attr,
+	&ods5_attr_stats_reset.attr,
+	&ods5_attr_slow_us.attr,
+	&ods5_attr_top_files.attr,
+	&ods5_attr_cache_bytes.attr,
+	&ods5_attr_cache_usage.attr,
+	&ods5_attr_cache_budget_kb.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(ods5);
+
+static ssize_t ods5_attr_show(struct kobject *kobj, struct attribute *attr,
+			      char *buf)
+{
+	struct ods5_sb_info *sb_info;
+	struct ods5_attr *a;
+	sb_info = container_of(kobj, struct ods5_sb_info, kobj);
+	a = container_of(attr, struct ods5_attr, attr);
+	if (!a->show)
+		return -EIO;
+	return a->show(sb_info, buf);
+}
+
+static ssize_t ods5_attr_store(struct kobject *kobj, struct attribute *attr,
+			       const char *buf, size_t len)
+{
+	struct ods5_sb_info *sb_info;
+	struct ods5_attr *a;
+	sb_info = container_of(kobj, struct ods5_sb_info, kobj);
+	a = container_of(attr, struct ods5_attr, attr);
+	if (!a->store)
+		return -EIO;
+	return a->store(sb_info, buf, len);
+}
+
+static void ods5_sb_release(struct kobject *kobj)
+{
+	struct ods5_sb_info *sb_info;
+	sb_info = container_of(kobj, struct ods5_sb_info, kobj);
+	complete(&sb_info->kobj_unregister);
+}
+
+static const struct sysfs_ops ods5_attr_ops = {
+	.show = ods5_attr_show,
+	.store = ods5_attr_store,
+};
+
+static struct kobj_type ods5_sb_ktype = {
+	.default_groups = ods5_groups,
+	.sysfs_ops = &ods5_attr_ops,
+	.release = ods5_sb_release,
+};
+
+int ods5_register_sysfs(struct super_block *sb)
+{
+	struct ods5_sb_info *sb_info;
+	int err;
+
+	sb_info = get_sb_info(sb);
+	sb_info->kobj.kset = ods5_kset;
+	init_completion(&sb_info->kobj_unregister);
+	err = kobject_init_and_add(&sb_info->kobj, &ods5_sb_ktype, NULL,
+				   "%s", sb->s_id);
+	if (err) {
+		kobject_put(&sb_info->kobj);
+		wait_for_completion(&sb_info->kobj_unregister);
+		return err;
+	}
+	sb_info->sysfs = 1;
+	return 0;
+}
+
+void ods5_unregister_sysfs(struct super_block *sb)
+{
+	struct ods5_sb_info *sb_info;
+
+	sb_info = get_sb_info(sb);
+	if (!sb_info->sysfs)
+		return;
+	kobject_put(&sb_info->kobj);
+	wait_for_completion(&sb_info->kobj_unregister);
+	sb_info->sysfs = 0;
+}
+
+int ods5_sysfs_init(void)
+{
+	ods5_kset = kset_create_and_add("ods5", NULL, fs_kobj);
+	if (!ods5_kset)
+		return -ENOMEM;
+	return 0;
+}
+
+void ods5_sysfs_exit(void)
+{
+	kset_unregister(ods5_kset);
+}
@@ -0,0 +1,210 @@
+/*
+ * linux/fs/ods5/warm.c
+ *
+ * This file is part of the OpenVMS ODS5 file system for Linux.
+ * Copyright (C) 2017 Hartmut Becker.
+ *
+ * The OpenVMS ODS5 file system for Linux is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The OpenVMS ODS5 file system for Linux is distributed in the hope that it
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/fs.h>
+#include <linux/workqueue.h>
+
+#include "./ods5_fs.h"
+#include "./ods5.h"
+
+/*
+ * Mount-time warm-up, mount option warm or warm=<depth>.
+ * Right after a mount nothing is cached and the first lookups read the
+ * file headers, extension headers and directory blocks one by one. Here
+ * this is done in the background, the mount doesn't wait for it:
+ * INDEXF.SYS with all its extension headers (they map the file headers of
+ * all files) and its bitmap, BITMAP.SYS and the MFD. Then the directories
+ * in the MFD and, down to depth levels, their subdirectories: their headers
+ * and retrieval pointers are decoded and their blocks are read ahead.
+ * The inodes are released when done, they stay in the inode cache.
+ * The progress is shown in /sys/fs/ods5/<device>/warm_*.
+ */
+
+static int warm_stopped(struct ods5_sb_info *sb_info)
+{
+	return READ_ONCE(sb_info->warm_state) == ODS5_WARM_STOPPED;
+}
+
+/*
+ * Map vbns 1..vbns of the file, which loads all its extension headers, and
+ * read ahead the mapped blocks, if data is set.
+ */
+static void warm_map(struct super_block *sb, struct inode *inode,
+		     vms_long vbns, int data)
+{
+	struct ods5_sb_info *sb_info;
+	vms_long vbn, lbn, extent;
+
+	sb_info = get_sb_info(sb);
+	for (vbn = 1; vbn <= vbns && !warm_stopped(sb_info); vbn += extent) {
+		if (!mapvbn(sb, inode, vbn, &lbn, &extent))
+			return;
+		if (extent > vbns - vbn + 1)
+			extent = vbns - vbn + 1;
+		if (data) {
+			ods5_mreadahead(sb, lbn, extent);
+			atomic_add(extent, &sb_info->warm_blocks);
+		}
+	}
+}
+
+/* the directory blocks and, if depth allows, the subdirectories */
+static void warm_dir(struct super_block *sb, struct inode *inode,
+		     vms_long depth)
+{
+	struct ods5_sb_info *sb_info;
+	struct ods5_mblk mb;
+	struct ods5_dir *dir;
+	struct ods5_dirent *dirval;
+	/* a directory record with a .DIR name and one entry has 20+ bytes */
+	struct ods5_fid fids[ODS5_BLOCK_SIZE / 16];
+	vms_long vbn, vbns, lbn, unused;
+	vms_long fnoff;
+	unsigned long ino;
+	char *block;
+	int i, n;
+
+	sb_info = get_sb_info(sb);
+	vbns = (inode->i_size + ODS5_BLOCK_SIZE - 1) >> ODS5_BLOCK_SHIFT;
+	warm_map(sb, inode, vbns, 1);
+	atomic_inc(&sb_info->warm_dirs);
+	ods5_debug(2, "dir ino: %lu, vbns: %d, depth: %d\n", inode->i_ino,
+		   vbns, depth);
+	if (depth == 0)
+		return;
+
+	for (vbn = 1; vbn <= vbns && !warm_stopped(sb_info); vbn++) {
+		if (!mapvbn(sb, inode, vbn, &lbn, &unused))
+			return;
+		block = ods5_mread(sb, lbn, &mb);
+		if (block == NULL)
+			return;
+		/* collect the subdirectories, don't hold the block while recursing */
+		n = 0;
+		for (fnoff = 0; fnoff < ODS5_BLOCK_SIZE - sizeof *dir
+		     && *(vms_word *)(block + fnoff) != NO_MORE_RECORDS;
+		     fnoff += dir->size + sizeof dir->size) {
+			dir = (struct ods5_dir *)(block + fnoff);
+			if (dir->flags.nametype == DIR_UCS2 || dir->namecount <= 4)
+				continue;
+			if (memcmp(&dir->name[dir->namecount - 4], ".DIR", 4) != 0)
+				continue;
+			dirval = (struct ods5_dirent *)(block + fnoff
+				+ offsetof(struct ods5_dir, name)
+				+ ((dir->namecount + 1) & ~1));
+			if ((char *)(dirval + 1) > block + ODS5_BLOCK_SIZE)
+				break;
+			if (dirval->version == 1 && n < ARRAY_SIZE(fids))
+				fids[n++] = dirval->fid;
+		}
+		ods5_mrelease(&mb);
+
+		for (i = 0; i < n && !warm_stopped(sb_info); i++) {
+			struct inode *sub;
+			ino = fids[i].num + (fids[i].nmx << 16);
+			/* 000000.DIR in the MFD is the MFD */
+			if (ino == ODS5_MFD_INO || ino == inode->i_ino)
+				continue;
+			sub = ods5_iget(sb, ino, fids[i].seq);
+			if (!sub)
+				continue;
+			atomic_inc(&sb_info->warm_headers);
+			if (S_ISDIR(sub->i_mode))
+				warm_dir(sb, sub, depth - 1);
+			iput(sub);
+		}
+	}
+}
+
+static void warm_work(struct work_struct *work)
+{
+	struct ods5_sb_info *sb_info;
+	struct super_block *sb;
+	struct inode *inode;
+
+	sb_info = container_of(work, struct ods5_sb_info, warm_work);
+	sb = sb_info->sb;
+	if (cmpxchg(&sb_info->warm_state, ODS5_WARM_QUEUED,
+		    ODS5_WARM_RUNNING) != ODS5_WARM_QUEUED)
+		return;
+	ods5_info("%s: warm-up started, depth: %d\n", sb->s_id,
+		  sb_info->warm_depth);
+
+	/* INDEXF.SYS: all extension headers and the index file bitmap */
+	inode = ods5_iget(sb, ODS5_INDEXF_INO, ODS5_INDEXF_INO);
+	if (inode) {
+		atomic_inc(&sb_info->warm_headers);
+		warm_map(sb, inode, inode->i_blocks, 0);
+		iput(inode);
+	}
+	ods5_mreadahead(sb, sb_info->indexflbn - sb_info->ibmapsize,
+			sb_info->ibmapsize);
+	atomic_add(sb_info->ibmapsize, &sb_info->warm_blocks);
+
+	/* BITMAP.SYS, the storage control block and the bitmap */
+	inode = ods5_iget(sb, ODS5_BITMAP_INO, ODS5_BITMAP_INO);
+	if (inode) {
+		atomic_inc(&sb_info->warm_headers);
+		warm_map(sb, inode,
+			 (inode->i_size + ODS5_BLOCK_SIZE - 1) >> ODS5_BLOCK_SHIFT, 1);
+		iput(inode);
+	}
+
+	/* the MFD and the directory tree */
+	inode = ods5_iget(sb, ODS5_MFD_INO, ODS5_MFD_INO);
+	if (inode) {
+		atomic_inc(&sb_info->warm_headers);
+		warm_dir(sb, inode, sb_info->warm_depth);
+		iput(inode);
+	}
+
+	cmpxchg(&sb_info->warm_state, ODS5_WARM_RUNNING, ODS5_WARM_DONE);
+	ods5_info("%s: warm-up %s, headers: %d, directories: %d, blocks: %d\n",
+		  sb->s_id, warm_stopped(sb_info) ? "stopped" : "done",
+		  atomic_read(&sb_info->warm_headers),
+		  atomic_read(&sb_info->warm_dirs),
+		  atomic_read(&sb_info->warm_blocks));
+}
+
+void ods5_warm_start(struct super_block *sb)
+{
+	struct ods5_sb_info *sb_info;
+
+	sb_info = get_sb_info(sb);
+	INIT_WORK(&sb_info->warm_work, warm_work);
+	if (!sb_info->warm_opt)
+		return;
+	WRITE_ONCE(sb_info->warm_state, ODS5_WARM_QUEUED);
+	queue_work(system_unbound_wq, &sb_info->warm_work);
+}
+
+/*
+ * Called before the unmount: the warm-up holds inode references, it must
+ * be finished before the inodes are evicted.
+ */
+void ods5_warm_stop(struct super_block *sb)
+{
+	struct ods5_sb_info *sb_info;
+
+	sb_info = get_sb_info(sb);
+	cmpxchg(&sb_info->warm_state, ODS5_WARM_QUEUED, ODS5_WARM_STOPPED);
+	cmpxchg(&sb_info->warm_state, ODS5_WARM_RUNNING, ODS5_WARM_STOPPED);
+	cancel_work_sync(&sb_info->warm_work);
+}